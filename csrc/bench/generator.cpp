@@ -0,0 +1,285 @@
+#include "generator.h"
+#include "LTL/error.h"
+#include "LTL/node_impl.h"
+#include "utils/irange.h"
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dark::bench {
+
+namespace {
+
+struct Spec {
+    std::string_view family;
+    std::vector<std::string> args;
+};
+
+auto parse_spec(std::string_view spec) -> Spec {
+    const auto colon = spec.find(':');
+    auto result      = Spec{spec.substr(0, colon), {}};
+    if (colon == std::string_view::npos)
+        return result;
+    auto rest = spec.substr(colon + 1);
+    while (true) {
+        const auto comma = rest.find(',');
+        result.args.emplace_back(rest.substr(0, comma));
+        if (comma == std::string_view::npos)
+            return result;
+        rest = rest.substr(comma + 1);
+    }
+}
+
+auto arg_int(const Spec &spec, std::size_t i, std::size_t fallback) -> std::size_t {
+    if (i >= spec.args.size())
+        return fallback;
+    return std::stoull(spec.args[i]);
+}
+
+auto arg_real(const Spec &spec, std::size_t i, double fallback) -> double {
+    if (i >= spec.args.size())
+        return fallback;
+    return std::stod(spec.args[i]);
+}
+
+// AP names must match [a-z]+, so the index is spelled with letters
+auto ap_name(std::size_t i) -> std::string {
+    auto name = std::string{"p"};
+    do {
+        name.push_back(static_cast<char>('a' + i % 26));
+        i /= 26;
+    } while (i != 0);
+    return name;
+}
+
+struct ModelBuilder {
+public:
+    ModelBuilder(std::size_t num_states, std::size_t num_aps) :
+        num_aps(num_aps), labels(num_states) {}
+
+    auto edge(std::size_t from, std::size_t into) -> void {
+        edges.emplace_back(from, into);
+    }
+
+    auto label(std::size_t state, std::size_t ap) -> void {
+        labels[state].push_back(ap);
+    }
+
+    auto finish(std::string name, const std::vector<std::size_t> &initial) const -> Model {
+        auto text = std::format("{} {}\n", labels.size(), edges.size());
+        for (const auto i : initial)
+            text += std::format("{} ", i);
+        text += "\ngo\n";
+        for (const auto i : irange(num_aps))
+            text += ap_name(i) + ' ';
+        text += '\n';
+        for (const auto &[from, into] : edges)
+            text += std::format("{} 0 {}\n", from, into);
+        for (const auto &aps : labels) {
+            for (const auto i : aps)
+                text += std::format("{} ", i);
+            text += '\n';
+        }
+        return Model{std::move(name), std::move(text)};
+    }
+
+    const std::size_t num_aps;
+
+private:
+    std::vector<std::pair<std::size_t, std::size_t>> edges;
+    std::vector<std::vector<std::size_t>> labels;
+};
+
+// a single cycle, AP j holds on every (j + 2)-th state
+auto make_ring(std::size_t n, std::size_t num_aps) -> ModelBuilder {
+    auto builder = ModelBuilder{n, num_aps};
+    for (const auto i : irange(n)) {
+        builder.edge(i, (i + 1) % n);
+        for (const auto j : irange(num_aps))
+            if (i % (j + 2) == 0)
+                builder.label(i, j);
+    }
+    return builder;
+}
+
+// a torus, each cell moves right or down, AP j holds on every (j + 2)-th diagonal
+auto make_grid(std::size_t w, std::size_t h, std::size_t num_aps) -> ModelBuilder {
+    auto builder = ModelBuilder{w * h, num_aps};
+    for (const auto y : irange(h)) {
+        for (const auto x : irange(w)) {
+            const auto i = y * w + x;
+            builder.edge(i, y * w + (x + 1) % w);
+            builder.edge(i, ((y + 1) % h) * w + x);
+            for (const auto j : irange(num_aps))
+                if ((x + y) % (j + 2) == 0)
+                    builder.label(i, j);
+        }
+    }
+    return builder;
+}
+
+// reachable state space of n dining philosophers, AP j holds when philosopher j eats
+auto make_philosophers(std::size_t n) -> ModelBuilder {
+    enum : std::uint8_t { Think, Left, Eat };
+    using Config = std::vector<std::uint8_t>;
+
+    const auto encode = [](const Config &c) {
+        auto code = std::uint64_t{};
+        for (const auto s : c)
+            code = code * 3 + s;
+        return code;
+    };
+
+    // fork i is the left fork of philosopher i and the right fork of philosopher i - 1
+    const auto fork_free = [n](const Config &c, std::size_t i) {
+        return c[i] == Think && c[(i + n - 1) % n] != Eat;
+    };
+
+    auto configs = std::vector<Config>{Config(n, Think)};
+    auto ids     = std::unordered_map<std::uint64_t, std::size_t>{{encode(configs[0]), 0}};
+    auto edges   = std::vector<std::pair<std::size_t, std::size_t>>{};
+    for (std::size_t cur = 0; cur < configs.size(); ++cur) {
+        for (const auto i : irange(n)) {
+            auto next = configs[cur];
+            if (next[i] == Think && fork_free(next, i))
+                next[i] = Left;
+            else if (next[i] == Left && fork_free(next, (i + 1) % n))
+                next[i] = Eat;
+            else if (next[i] == Eat)
+                next[i] = Think;
+            else
+                continue;
+            const auto [it, success] = ids.try_emplace(encode(next), configs.size());
+            if (success)
+                configs.push_back(std::move(next));
+            edges.emplace_back(cur, it->second);
+        }
+    }
+
+    auto builder = ModelBuilder{configs.size(), n};
+    for (const auto &[from, into] : edges)
+        builder.edge(from, into);
+    for (const auto i : irange(configs.size()))
+        for (const auto j : irange(n))
+            if (configs[i][j] == Eat)
+                builder.label(i, j);
+    return builder;
+}
+
+// each state has `degree` uniformly random successors, each AP holds with `density`
+auto make_random(
+    std::size_t n, std::size_t degree, double density, std::size_t seed, std::size_t num_aps
+) -> ModelBuilder {
+    auto builder = ModelBuilder{n, num_aps};
+    auto rng     = std::mt19937_64{seed};
+    auto pick    = std::uniform_int_distribution<std::size_t>{0, n - 1};
+    auto coin    = std::bernoulli_distribution{density};
+    for (const auto i : irange(n)) {
+        for ([[maybe_unused]] const auto _ : irange(degree))
+            builder.edge(i, pick(rng));
+        for (const auto j : irange(num_aps))
+            if (coin(rng))
+                builder.label(i, j);
+    }
+    return builder;
+}
+
+auto ap(std::size_t i) -> NodePtr {
+    return std::make_unique<AtomicNode>(i);
+}
+
+template <typename Node>
+auto unary(NodePtr child) -> NodePtr {
+    return std::make_unique<Node>(std::move(child));
+}
+
+template <typename Node>
+auto binary(NodePtr lhs, NodePtr rhs) -> NodePtr {
+    return std::make_unique<Node>(std::move(lhs), std::move(rhs));
+}
+
+// conjunction with an optional left hand side
+auto conjunction(NodePtr lhs, NodePtr rhs) -> NodePtr {
+    return lhs ? binary<ConjNode>(std::move(lhs), std::move(rhs)) : std::move(rhs);
+}
+
+} // namespace
+
+auto make_model(std::string_view str, std::size_t num_aps) -> Model {
+    const auto spec = parse_spec(str);
+    const auto name = std::string{str};
+    if (spec.family == "ring") {
+        const auto n = arg_int(spec, 0, 1000);
+        docheck(n > 0, "ring must have at least 1 state");
+        return make_ring(n, num_aps).finish(name, {0});
+    }
+    if (spec.family == "grid") {
+        const auto w = arg_int(spec, 0, 32);
+        const auto h = arg_int(spec, 1, w);
+        docheck(w > 0 && h > 0, "grid must have at least 1 state");
+        return make_grid(w, h, num_aps).finish(name, {0});
+    }
+    if (spec.family == "philosophers") {
+        const auto n = arg_int(spec, 0, 5);
+        docheck(n >= 2 && n <= 40, "philosophers must be in [2, 40]");
+        docheck(n >= num_aps, "philosophers must be no less than number of APs");
+        return make_philosophers(n).finish(name, {0});
+    }
+    if (spec.family == "random") {
+        const auto n      = arg_int(spec, 0, 1000);
+        const auto degree = arg_int(spec, 1, 3);
+        const auto prob   = arg_real(spec, 2, 0.5);
+        const auto seed   = arg_int(spec, 3, 42);
+        docheck(n > 0, "random model must have at least 1 state");
+        return make_random(n, degree, prob, seed, num_aps).finish(name, {0});
+    }
+    docheck(false, "Unknown model family: {}", spec.family);
+    return {};
+}
+
+auto make_formula(std::string_view str) -> Formula {
+    const auto spec = parse_spec(str);
+    const auto k    = arg_int(spec, 0, 2);
+    docheck(k > 0, "formula size must be positive");
+    auto result = Formula{std::string{str}, nullptr, 0};
+
+    if (spec.family == "until") { // p0 U (p1 U (... U pk))
+        result.root    = ap(k);
+        result.num_aps = k + 1;
+        for (auto i = k; i-- > 0;)
+            result.root = binary<UntilNode>(ap(i), std::move(result.root));
+    } else if (spec.family == "gf") { // G F p0 /\ ... /\ G F p(k-1)
+        result.num_aps = k;
+        for (const auto i : irange(k)) {
+            auto gf     = unary<AlwaysNode>(unary<EventualNode>(ap(i)));
+            result.root = conjunction(std::move(result.root), std::move(gf));
+        }
+    } else if (spec.family == "response") { // G (p0 -> F p1) /\ ... /\ G (p(k-1) -> F pk)
+        result.num_aps = k + 1;
+        for (const auto i : irange(k)) {
+            auto eventual = unary<EventualNode>(ap(i + 1));
+            auto response = unary<AlwaysNode>(binary<ImplNode>(ap(i), std::move(eventual)));
+            result.root   = conjunction(std::move(result.root), std::move(response));
+        }
+    } else {
+        docheck(false, "Unknown formula family: {}", spec.family);
+    }
+    return result;
+}
+
+auto default_models() -> std::vector<std::string> {
+    return {"ring:100000", "grid:300,300", "philosophers:8", "random:100000,4,0.3"};
+}
+
+auto default_formulas() -> std::vector<std::string> {
+    return {"until:2", "gf:1", "response:1"};
+}
+
+} // namespace dark::bench
@@ -0,0 +1,32 @@
+#pragma once
+#include "LTL/node.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dark::bench {
+
+// A generated transition system, in the input format of `TSGraph::read`
+struct Model {
+    std::string name;
+    std::string text;
+};
+
+// A generated LTL formula, which uses the first `num_aps` atomic propositions
+struct Formula {
+    std::string name;
+    NodePtr root;
+    std::size_t num_aps;
+};
+
+// spec: "ring:N", "grid:W,H", "philosophers:N" or "random:N,DEGREE,DENSITY[,SEED]"
+auto make_model(std::string_view spec, std::size_t num_aps) -> Model;
+
+// spec: "until:K", "gf:K" or "response:K"
+auto make_formula(std::string_view spec) -> Formula;
+
+auto default_models() -> std::vector<std::string>;
+auto default_formulas() -> std::vector<std::string>;
+
+} // namespace dark::bench
@@ -0,0 +1,209 @@
+#include "LTL/automa.h"
+#include "LTL/context.h"
+#include "LTL/error.h"
+#include "LTL/node.h"
+#include "LTL/search.h"
+#include "LTL/ts.h"
+#include "generator.h"
+#include "utils/irange.h"
+#include <algorithm>
+#include <argparse/argparse.hpp>
+#include <chrono>
+#include <cstddef>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace dark;
+
+struct Record {
+    std::string model;
+    std::string formula;
+    std::string order;
+    std::size_t ts_states;
+    std::size_t gnba_states;
+    std::size_t nba_states;
+    bool holds;
+    double parse_ms;   // TSGraph::read
+    double reorder_ms; // TSGraph::reorder
+    double gnba_ms;    // GNBA::build
+    double nba_ms;     // NBA::fromGNBA
+    double product_ms; // ProductSystem::can_run
+};
+
+// run the function, and keep the minimum time in milliseconds
+template <typename _Fn>
+auto timeit(double &best, _Fn &&fn) -> decltype(auto) {
+    const auto start      = std::chrono::steady_clock::now();
+    decltype(auto) result = fn();
+    const auto finish     = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double, std::milli>(finish - start).count());
+    return result;
+}
+
+auto run_case(
+    const bench::Model &model, const bench::Formula &formula, const std::string &order,
+    std::size_t repeat
+) -> Record {
+    static constexpr auto kInf = std::numeric_limits<double>::infinity();
+
+    auto record = Record{
+        .model       = model.name,
+        .formula     = formula.name,
+        .order       = order,
+        .ts_states   = 0,
+        .gnba_states = 0,
+        .nba_states  = 0,
+        .holds       = false,
+        .parse_ms    = kInf,
+        .reorder_ms  = kInf,
+        .gnba_ms     = kInf,
+        .nba_ms      = kInf,
+        .product_ms  = kInf,
+    };
+
+    // the buffers are warm from the second run on, as with a stream of queries
+    auto context = VerificationContext{};
+    for ([[maybe_unused]] const auto _ : irange(repeat)) {
+        auto graph = timeit(record.parse_ms, [&] {
+            auto is = std::istringstream{model.text};
+            return TSGraph::read(is);
+        });
+        timeit(record.reorder_ms, [&] {
+            graph.reorder(*parse_state_order(order));
+            return 0;
+        });
+        const auto view = TSView{graph};
+        const auto gnba = timeit(record.gnba_ms, [&] {
+            return GNBA::build(formula.root.get(), view.num_atomics, /*negate=*/true);
+        });
+        const auto nba     = timeit(record.nba_ms, [&] { return NBA::fromGNBA(gnba); });
+        record.holds       = timeit(record.product_ms, [&] {
+            return verifyLTL(nba, view, {}, context);
+        });
+        record.ts_states   = view.num_states;
+        record.gnba_states = gnba.num_states();
+        record.nba_states  = nba.num_states();
+    }
+    return record;
+}
+
+auto print_csv_header(std::ostream &os) -> void {
+    os << "model,formula,order,ts_states,gnba_states,nba_states,holds,"
+          "parse_ms,reorder_ms,gnba_ms,nba_ms,product_ms\n";
+}
+
+auto print_csv(std::ostream &os, const Record &r) -> void {
+    os << std::format(
+        "\"{}\",\"{}\",{},{},{},{},{},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f}\n", r.model, r.formula,
+        r.order, r.ts_states, r.gnba_states, r.nba_states, static_cast<int>(r.holds), r.parse_ms,
+        r.reorder_ms, r.gnba_ms, r.nba_ms, r.product_ms
+    );
+}
+
+auto print_json(std::ostream &os, const Record &r) -> void {
+    os << std::format(
+        "{{\"model\": \"{}\", \"formula\": \"{}\", \"order\": \"{}\", \"ts_states\": {}, "
+        "\"gnba_states\": {}, \"nba_states\": {}, \"holds\": {}, \"parse_ms\": {:.3f}, "
+        "\"reorder_ms\": {:.3f}, \"gnba_ms\": {:.3f}, \"nba_ms\": {:.3f}, "
+        "\"product_ms\": {:.3f}}}\n",
+        r.model, r.formula, r.order, r.ts_states, r.gnba_states, r.nba_states, r.holds, r.parse_ms,
+        r.reorder_ms, r.gnba_ms, r.nba_ms, r.product_ms
+    );
+}
+
+auto work(int argc, const char **argv) -> void {
+    auto program = argparse::ArgumentParser{"LTL-bench", "1.0.0"};
+
+    program.add_argument("--model")
+        .help("Model spec: ring:N, grid:W,H, philosophers:N or random:N,DEGREE,DENSITY[,SEED]")
+        .append();
+    program.add_argument("--formula").help("Formula spec: until:K, gf:K or response:K").append();
+    program.add_argument("--order")
+        .help("TS state order: input, bfs, dfs or rcm, each one is a separate case")
+        .append();
+    program.add_argument("--repeat")
+        .help("Number of runs per case, the minimum time is reported")
+        .default_value(std::string{"3"});
+    program.add_argument("--format").help("Output format: json or csv").default_value(
+        std::string{"json"}
+    );
+    program.add_argument("--output").help("Output file path").nargs(1);
+
+    program.parse_args(argc, argv);
+
+    const auto models   = program.present<std::vector<std::string>>("--model")
+                              .value_or(bench::default_models());
+    const auto formulas = program.present<std::vector<std::string>>("--formula")
+                              .value_or(bench::default_formulas());
+    const auto orders   = program.present<std::vector<std::string>>("--order")
+                              .value_or(std::vector<std::string>{"input"});
+    const auto repeat   = std::stoull(program.get("--repeat"));
+    const auto format   = program.get("--format");
+    if (format != "json" && format != "csv")
+        throw std::runtime_error("Unknown output format: " + format);
+    for (const auto &order : orders)
+        if (!parse_state_order(order))
+            throw std::runtime_error("Unknown state order: " + order);
+    if (repeat == 0)
+        throw std::runtime_error("Repeat must be positive");
+
+    auto out_file    = std::ofstream{};
+    auto &out_stream = [&] -> std::ostream & {
+        if (program.present("--output")) {
+            out_file.open(program.get("--output"));
+            return out_file;
+        } else {
+            return std::cout;
+        }
+    }();
+
+    // debug output of the library would only pollute the timing
+    debugger(false);
+
+    auto parsed  = std::vector<bench::Formula>{};
+    auto num_aps = std::size_t{1};
+    for (const auto &spec : formulas) {
+        parsed.push_back(bench::make_formula(spec));
+        num_aps = std::max(num_aps, parsed.back().num_aps);
+    }
+
+    if (format == "csv")
+        print_csv_header(out_stream);
+    for (const auto &spec : models) {
+        const auto model = bench::make_model(spec, num_aps);
+        for (const auto &formula : parsed) {
+            for (const auto &order : orders) {
+                const auto record = run_case(model, formula, order, repeat);
+                if (format == "csv")
+                    print_csv(out_stream, record);
+                else
+                    print_json(out_stream, record);
+                out_stream.flush();
+            }
+        }
+    }
+}
+
+} // namespace
+
+auto main(int argc, const char **argv) -> int {
+    try {
+        work(argc, argv);
+    } catch (const dark::LTLException &e) {
+        std::cerr << std::format("Invalid benchmark spec: {}\n", e.what());
+        return 1;
+    } catch (const std::exception &e) {
+        std::cerr << std::format("Implementation Error: {}\n", e.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include "LTL/automa.h"
+#include "LTL/stats.h"
+#include "product.h"
+#include "utils/bitset.h"
+#include "utils/error.h"
+#include "utils/irange.h"
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace dark {
+
+namespace {
+
+// a set of NBA states, one bit per state
+using Mask = std::uint64_t;
+
+// a set of product states: TS state -> set of NBA states
+using MaskSet = std::vector<Mask>;
+
+// the NBA states of a set, of an NBA with at most 64 states
+template <typename _Set>
+auto to_mask(const _Set &set) -> Mask {
+    auto result = Mask{};
+    for (const auto q : set)
+        result |= Mask{1} << q;
+    return result;
+}
+
+auto count(const MaskSet &set) -> std::size_t {
+    auto result = std::size_t{};
+    for (const auto m : set)
+        result += std::popcount(m);
+    return result;
+}
+
+struct BitwiseProduct {
+public:
+    template <typename _Set>
+    BitwiseProduct(const LabelClasses &ts, const BasicNBA<_Set> &nba);
+
+    // One-Way-Catch-Them-Young over the masks, forward only: alternately keep the
+    // states reachable from accepting states, and drop the states without predecessors.
+    // An accepting cycle exists iff the fixpoint is not empty.
+    auto can_run() const -> bool {
+        const auto full = MaskSet(ts.num_states, ~Mask{});
+        auto set        = closure(initial_states(), full);
+        call_in_stats_mode([&] { query_stats().outer_visited += count(set); });
+        while (count(set) != 0) {
+            const auto last = count(set);
+            set             = closure(accepting_states(set), set);
+            while (true) {
+                auto next = post(set);
+                for (const auto t : irange(ts.num_states))
+                    next[t] &= set[t];
+                if (next == set)
+                    break;
+                set = std::move(next);
+            }
+            call_in_stats_mode([&] { query_stats().inner_visited += count(set); });
+            if (count(set) == last)
+                break;
+        }
+        return count(set) != 0;
+    }
+
+private:
+    // lookup tables per label class, for up to kMaxTables classes
+    inline static constexpr auto kMaxTables = std::size_t{1024};
+
+    using Table = std::array<std::array<Mask, 256>, 8>;
+
+    // NBA states reached from any state of the mask, on a label class
+    auto image(std::size_t label, Mask mask) const -> Mask {
+        if (!tables.empty()) {
+            const auto &table = tables[label];
+            auto result       = Mask{};
+            for (const auto i : irange(8))
+                result |= table[i][(mask >> (i * 8)) & 0xFF];
+            return result;
+        }
+        auto result = Mask{};
+        for (; mask != 0; mask &= mask - 1)
+            result |= succ[label * 64 + std::countr_zero(mask)];
+        return result;
+    }
+
+    auto initial_states() const -> MaskSet {
+        auto result = MaskSet(ts.num_states);
+        for (const auto &group : ts.initial()) {
+            const auto targets = image(group.label, initial);
+            for (const auto t : ts.states(group))
+                result[t] |= targets;
+        }
+        return result;
+    }
+
+    // accepting states, except those whose TS state is on no cycle
+    auto accepting_states(const MaskSet &set) const -> MaskSet {
+        auto result = set;
+        for (const auto t : irange(ts.num_states))
+            result[t] &= ts.on_cycle(t) ? final : 0;
+        return result;
+    }
+
+    // product states with a predecessor in the set
+    auto post(const MaskSet &set) const -> MaskSet {
+        auto result = MaskSet(ts.num_states);
+        for (const auto t : irange(ts.num_states)) {
+            if (set[t] == 0)
+                continue;
+            for (const auto &group : ts.post(t)) {
+                const auto targets = image(group.label, set[t]);
+                for (const auto s : ts.states(group))
+                    result[s] |= targets;
+            }
+        }
+        return result;
+    }
+
+    // product states reachable from the seeds, without leaving the given set
+    auto closure(const MaskSet &seeds, const MaskSet &within) const -> MaskSet {
+        auto result = MaskSet(ts.num_states);
+        auto delta  = MaskSet(ts.num_states); // bits not yet propagated
+        auto queue  = std::vector<std::size_t>{};
+        for (const auto t : irange(ts.num_states)) {
+            result[t] = delta[t] = seeds[t] & within[t];
+            if (delta[t] != 0)
+                queue.push_back(t);
+        }
+        while (!queue.empty()) {
+            const auto t = queue.back();
+            queue.pop_back();
+            const auto mask = std::exchange(delta[t], 0);
+            for (const auto &group : ts.post(t)) {
+                const auto targets = image(group.label, mask);
+                for (const auto s : ts.states(group)) {
+                    const auto fresh = targets & within[s] & ~result[s];
+                    if (fresh == 0)
+                        continue;
+                    result[s] |= fresh;
+                    if (delta[s] == 0)
+                        queue.push_back(s);
+                    delta[s] |= fresh;
+                }
+            }
+        }
+        return result;
+    }
+
+    const LabelClasses &ts;
+    Mask initial;
+    Mask final;
+    std::vector<Mask> succ;   // (label class, NBA state) -> targets
+    std::vector<Table> tables; // label class -> targets of each byte of a mask
+};
+
+template <typename _Set>
+BitwiseProduct::BitwiseProduct(const LabelClasses &ts, const BasicNBA<_Set> &nba) :
+    ts(ts), initial(to_mask(nba.initial_states)), final(to_mask(nba.final_states)),
+    succ(ts.num_labels() * 64) {
+    assume(nba.num_states <= kMaxBitwiseStates, "NBA too large for the masks");
+    for (const auto c : irange(ts.num_labels()))
+        for (const auto q : irange(nba.num_states))
+            if (auto *target = accept(nba, q, ts.label(c)))
+                succ[c * 64 + q] = to_mask(*target);
+
+    if (ts.num_labels() > kMaxTables)
+        return;
+    // each entry is the union of the entry without its lowest bit, and that bit
+    tables.resize(ts.num_labels());
+    for (const auto c : irange(ts.num_labels())) {
+        for (const auto i : irange(8)) {
+            auto &table = tables[c][i];
+            table[0]    = 0;
+            for (const auto b : irange(1, 256))
+                table[b] = table[b & (b - 1)] | succ[c * 64 + i * 8 + std::countr_zero(b)];
+        }
+    }
+}
+
+} // namespace
+
+auto bitwise_can_run(const LabelClasses &ts, const NBA &nba) -> bool {
+    return nba.visit([&](const auto &nba) { return BitwiseProduct{ts, nba}.can_run(); });
+}
+
+} // namespace dark
@@ -0,0 +1,471 @@
+#include "LTL/automa.h"
+#include "LTL/search.h"
+#include "LTL/stats.h"
+#include "product.h"
+#include "utils/irange.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <poll.h>
+#include <span>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <system_error>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dark {
+
+namespace {
+
+// product state (idx_ts, idx_nba), encoded as idx_ts * nba.num_states + idx_nba
+using Key = std::uint64_t;
+
+[[noreturn]]
+auto fail(const char *what) -> void {
+    throw std::system_error(errno, std::generic_category(), what);
+}
+
+// The sockets of a worker to all the others, by rank. A message is a batch of keys,
+// sent with its length first. Sends are buffered, and every wait both flushes them and
+// reads ahead from every peer, so two workers never block each other.
+struct Mesh {
+public:
+    Mesh(std::size_t rank, std::span<const int> fds) : my_rank(rank), peers(fds.size()) {
+        for (const auto i : irange(fds.size()))
+            peers[i].fd = fds[i];
+    }
+    Mesh(const Mesh &) = delete;
+    ~Mesh() {
+        for (const auto &peer : peers)
+            if (peer.fd >= 0)
+                ::close(peer.fd);
+    }
+
+    auto rank() const -> std::size_t {
+        return my_rank;
+    }
+    auto size() const -> std::size_t {
+        return peers.size();
+    }
+
+    // send a batch to every worker, and return the batches received from all of them
+    auto exchange(std::vector<std::vector<Key>> batches) -> std::vector<Key> {
+        for (const auto i : irange(size()))
+            if (i != my_rank)
+                post(i, batches[i]);
+        auto result = std::move(batches[my_rank]);
+        for (const auto i : irange(size()))
+            if (i != my_rank) {
+                const auto batch = receive(i);
+                result.insert(result.end(), batch.begin(), batch.end());
+            }
+        return result;
+    }
+
+    // the sum of the values of all the workers. A token goes around the ring once to
+    // add them up, and once more to hand the total to everyone
+    auto sum(Key value) -> Key {
+        if (size() == 1)
+            return value;
+        const auto next = (my_rank + 1) % size();
+        const auto prev = (my_rank + size() - 1) % size();
+        if (my_rank == 0) {
+            post(next, {&value, 1});
+            const auto total = receive(prev).at(0);
+            post(next, {&total, 1});
+            flush();
+            return total;
+        }
+        const auto partial = receive(prev).at(0) + value;
+        post(next, {&partial, 1});
+        const auto total = receive(prev).at(0);
+        if (next != 0)
+            post(next, {&total, 1});
+        flush();
+        return total;
+    }
+
+private:
+    struct Peer {
+        int fd      = -1;
+        bool closed = false;                // the peer has exited
+        std::vector<Key> out;               // batches to send, with their lengths
+        std::size_t written = 0;            // bytes of out sent
+        std::vector<char> in;               // bytes received, not a whole batch yet
+        std::deque<std::vector<Key>> inbox; // batches received
+    };
+
+    auto post(std::size_t to, std::span<const Key> keys) -> void {
+        auto &out = peers[to].out;
+        out.push_back(keys.size());
+        out.insert(out.end(), keys.begin(), keys.end());
+    }
+
+    auto receive(std::size_t from) -> std::vector<Key> {
+        auto &peer = peers[from];
+        pump([&peer] { return !peer.inbox.empty() || peer.closed; });
+        if (peer.inbox.empty())
+            throw std::runtime_error("a distributed worker exited early");
+        auto batch = std::move(peer.inbox.front());
+        peer.inbox.pop_front();
+        return batch;
+    }
+
+    auto flush() -> void {
+        pump([this] {
+            return std::ranges::all_of(peers, [](const Peer &p) { return p.out.empty(); });
+        });
+    }
+
+    // move bytes both ways on every socket which is ready, until done() holds
+    template <typename _Fn>
+    auto pump(_Fn &&done) -> void {
+        auto fds   = std::vector<pollfd>{};
+        auto ranks = std::vector<std::size_t>{};
+        while (!done()) {
+            fds.clear();
+            ranks.clear();
+            for (const auto i : irange(size())) {
+                auto &peer = peers[i];
+                if (i == my_rank || peer.closed)
+                    continue;
+                const auto events = POLLIN | (peer.out.empty() ? 0 : POLLOUT);
+                fds.push_back({peer.fd, static_cast<short>(events), 0});
+                ranks.push_back(i);
+            }
+            if (fds.empty())
+                throw std::runtime_error("all distributed workers exited early");
+            if (::poll(fds.data(), fds.size(), -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                fail("poll");
+            }
+            for (const auto j : irange(fds.size())) {
+                if (fds[j].revents & POLLOUT)
+                    send_some(peers[ranks[j]]);
+                if (fds[j].revents & (POLLIN | POLLHUP | POLLERR))
+                    receive_some(peers[ranks[j]]);
+            }
+        }
+    }
+
+    static auto send_some(Peer &peer) -> void {
+        const auto *data = reinterpret_cast<const char *>(peer.out.data());
+        const auto total = peer.out.size() * sizeof(Key);
+        const auto n =
+            ::send(peer.fd, data + peer.written, total - peer.written, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return;
+            if (errno == EPIPE || errno == ECONNRESET)
+                throw std::runtime_error("a distributed worker exited early");
+            fail("send");
+        }
+        peer.written += n;
+        if (peer.written == total) {
+            peer.out.clear();
+            peer.written = 0;
+        }
+    }
+
+    static auto receive_some(Peer &peer) -> void {
+        static constexpr auto kChunk = std::size_t{1} << 16;
+        const auto size              = peer.in.size();
+        peer.in.resize(size + kChunk);
+        const auto n = ::recv(peer.fd, peer.in.data() + size, kChunk, MSG_DONTWAIT);
+        peer.in.resize(size + std::max<ssize_t>(n, 0));
+        if (n == 0 || (n < 0 && errno == ECONNRESET)) {
+            peer.closed = true;
+            return;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return;
+            fail("recv");
+        }
+        // cut the whole batches off the front
+        auto pos = std::size_t{};
+        while (peer.in.size() - pos >= sizeof(Key)) {
+            auto length = Key{};
+            std::memcpy(&length, peer.in.data() + pos, sizeof(Key));
+            const auto bytes = (length + 1) * sizeof(Key);
+            if (peer.in.size() - pos < bytes)
+                break;
+            auto &batch = peer.inbox.emplace_back(length);
+            std::memcpy(batch.data(), peer.in.data() + pos + sizeof(Key), length * sizeof(Key));
+            pos += bytes;
+        }
+        peer.in.erase(peer.in.begin(), peer.in.begin() + pos);
+    }
+
+    const std::size_t my_rank;
+    std::vector<Peer> peers;
+};
+
+// The states of the product are partitioned by hash among the workers, and each worker
+// keeps only its own part. Every phase goes level by level, in lockstep: each worker
+// expands its part of the frontier, sends the successors to their owners, and keeps
+// those of the received states that it did not have. A token ring then tells whether
+// the frontiers of all the workers are empty. On top of that, One-Way-Catch-Them-Young:
+// alternately keep the states reachable from accepting states, and drop the states
+// without predecessors, by counting them. An accepting cycle exists iff the fixpoint is
+// not empty. Each worker has its own copy of the TS and the NBA.
+template <typename _Set>
+struct DistributedProduct {
+public:
+    using NBA = BasicNBA<_Set>;
+
+    DistributedProduct(const LabelClasses &ts, const NBA &nba, Mesh &mesh) :
+        ts(ts), nba(nba), mesh(mesh) {}
+
+    auto can_run() -> bool {
+        explore();
+        auto size = mesh.sum(states.size());
+        call_in_stats_mode([&] { query_stats().outer_visited += size; });
+        while (size != 0) {
+            const auto last = size;
+            reach();
+            size = eliminate();
+            call_in_stats_mode([&] { query_stats().inner_visited += size; });
+            if (size == last)
+                break;
+        }
+        return size != 0;
+    }
+
+private:
+    struct Slot {
+        bool in_set       = true;  // in the current OWCTY set
+        bool reached      = false; // reached from an accepting state of the set
+        std::size_t count = 0;     // predecessors in the set, not dropped yet
+    };
+
+    auto encode(std::size_t idx_ts, std::size_t idx_nba) const -> Key {
+        return static_cast<Key>(idx_ts) * nba.num_states + idx_nba;
+    }
+
+    auto owner(Key key) const -> std::size_t {
+        return ((key * 0x9E3779B97F4A7C15ull) >> 32) % mesh.size();
+    }
+
+    template <typename _Fn>
+    auto for_each_post(std::span<const LabelClasses::Group> groups, std::size_t idx_nba, _Fn &&fn)
+        const -> void {
+        for (const auto &group : groups)
+            if (auto *target = accept(nba, idx_nba, ts.label(group)))
+                for (const auto t : ts.states(group))
+                    for (const auto q : *target)
+                        fn(encode(t, q));
+    }
+
+    // accepting states, except those whose TS state is on no cycle
+    auto is_accepting(Key key) const -> bool {
+        return nba.final_states[key % nba.num_states] && ts.on_cycle(key / nba.num_states);
+    }
+
+    // send the successors of the states to their owners, and return those received
+    auto step(std::span<const Key> keys) -> std::vector<Key> {
+        auto batches = std::vector<std::vector<Key>>(mesh.size());
+        for (const auto key : keys) {
+            const auto idx_ts  = static_cast<std::size_t>(key / nba.num_states);
+            const auto idx_nba = static_cast<std::size_t>(key % nba.num_states);
+            for_each_post(ts.post(idx_ts), idx_nba, [&](Key next) {
+                batches[owner(next)].push_back(next);
+            });
+        }
+        return mesh.exchange(std::move(batches));
+    }
+
+    // go level by level until every frontier is empty, where visit(key) tells whether a
+    // received state joins the next frontier
+    template <typename _Fn>
+    auto propagate(std::vector<Key> frontier, _Fn &&visit) -> void {
+        while (mesh.sum(frontier.size()) != 0) {
+            auto next = std::vector<Key>{};
+            for (const auto key : step(frontier))
+                if (visit(key))
+                    next.push_back(key);
+            frontier = std::move(next);
+        }
+    }
+
+    auto explore() -> void {
+        auto frontier = std::vector<Key>{};
+        for (const auto i : nba.initial_states)
+            for_each_post(ts.initial(), i, [&](Key key) {
+                if (owner(key) == mesh.rank() && states.try_emplace(key).second)
+                    frontier.push_back(key);
+            });
+        propagate(std::move(frontier), [this](Key key) {
+            return states.try_emplace(key).second;
+        });
+    }
+
+    // keep the states of the set reachable from its accepting states
+    auto reach() -> void {
+        auto frontier = std::vector<Key>{};
+        for (auto &[key, slot] : states) {
+            slot.reached = slot.in_set && is_accepting(key);
+            if (slot.reached)
+                frontier.push_back(key);
+        }
+        propagate(std::move(frontier), [this](Key key) {
+            auto &slot = states.at(key);
+            if (!slot.in_set || slot.reached)
+                return false;
+            slot.reached = true;
+            return true;
+        });
+        for (auto &[key, slot] : states)
+            slot.in_set = slot.reached;
+    }
+
+    // drop the states of the set without predecessors in it, until there are none.
+    // return the size of the set, over all the workers
+    auto eliminate() -> std::size_t {
+        auto members = std::vector<Key>{};
+        for (auto &[key, slot] : states) {
+            slot.count = 0;
+            if (slot.in_set)
+                members.push_back(key);
+        }
+        for (const auto key : step(members))
+            if (auto &slot = states.at(key); slot.in_set)
+                ++slot.count;
+
+        auto frontier = std::vector<Key>{};
+        for (const auto key : members)
+            if (states.at(key).count == 0)
+                frontier.push_back(key);
+        propagate(std::move(frontier), [this](Key key) {
+            auto &slot = states.at(key);
+            return slot.in_set && slot.count != 0 && --slot.count == 0;
+        });
+
+        auto size = std::size_t{};
+        for (auto &[key, slot] : states) {
+            slot.in_set = slot.in_set && slot.count != 0;
+            size       += slot.in_set;
+        }
+        return mesh.sum(size);
+    }
+
+    const LabelClasses &ts;
+    const NBA &nba;
+    Mesh &mesh;
+    std::unordered_map<Key, Slot> states; // the states owned by this worker
+};
+
+auto run_worker(const LabelClasses &ts, const NBA &nba, Mesh &mesh) -> bool {
+    return nba.visit([&]<typename _Set>(const BasicNBA<_Set> &nba) {
+        auto product = DistributedProduct<_Set>{ts, nba, mesh};
+        return product.can_run();
+    });
+}
+
+// the forked workers, waited for when leaving the scope
+struct Children {
+public:
+    Children() = default;
+    Children(const Children &) = delete;
+    ~Children() {
+        join();
+    }
+
+    auto add(pid_t pid) -> void {
+        pids.push_back(pid);
+    }
+
+    // wait for all the workers, and whether they all exited normally
+    auto join() -> bool {
+        auto success = true;
+        for (const auto pid : pids) {
+            auto status = 0;
+            auto waited = ::waitpid(pid, &status, 0);
+            while (waited < 0 && errno == EINTR)
+                waited = ::waitpid(pid, &status, 0);
+            success = success && waited == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        pids.clear();
+        return success;
+    }
+
+private:
+    std::vector<pid_t> pids;
+};
+
+} // namespace
+
+auto distributed_can_run(const LabelClasses &ts, const NBA &nba, const SearchOptions &options)
+    -> bool {
+    const auto num_workers = std::max<std::size_t>(options.distributed_workers, 1);
+
+    // fds[i][j]: the socket of worker i to worker j
+    auto fds = std::vector<std::vector<int>>(num_workers, std::vector<int>(num_workers, -1));
+    const auto close_except = [&fds](std::size_t rank) {
+        for (const auto i : irange(fds.size()))
+            for (auto &fd : fds[i])
+                if (i != rank && fd >= 0)
+                    ::close(std::exchange(fd, -1));
+    };
+    for (const auto i : irange(num_workers))
+        for (const auto j : irange(i + 1, num_workers)) {
+            int pair[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+                close_except(num_workers);
+                fail("socketpair");
+            }
+            fds[i][j] = pair[0];
+            fds[j][i] = pair[1];
+        }
+
+    // anything still buffered would be written once more by every child
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+
+    // the calling process is worker 0, and the others are forked. A child leaves with
+    // _Exit: it must not run the destructors of the state it shares with the parent.
+    auto children = Children{};
+    for (const auto rank : irange<std::size_t>(1, num_workers)) {
+        const auto pid = ::fork();
+        if (pid < 0) {
+            close_except(num_workers);
+            fail("fork");
+        }
+        if (pid == 0) {
+            close_except(rank);
+            auto code = EXIT_SUCCESS;
+            try {
+                auto mesh = Mesh{rank, fds[rank]};
+                run_worker(ts, nba, mesh);
+            } catch (...) {
+                code = EXIT_FAILURE;
+            }
+            std::_Exit(code);
+        }
+        children.add(pid);
+    }
+    close_except(0);
+
+    auto result = false;
+    {
+        auto mesh = Mesh{0, fds[0]};
+        result    = run_worker(ts, nba, mesh);
+    }
+    if (!children.join())
+        throw std::runtime_error("a distributed worker failed");
+    return result;
+}
+
+} // namespace dark
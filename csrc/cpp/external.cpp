@@ -0,0 +1,599 @@
+#include "LTL/automa.h"
+#include "LTL/search.h"
+#include "LTL/stats.h"
+#include "product.h"
+#include "utils/irange.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace dark {
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// product state (idx_ts, idx_nba), encoded as idx_ts * nba.num_states + idx_nba
+using Key = std::uint64_t;
+
+inline constexpr auto kBlock    = std::size_t{1} << 16; // keys per disk read/write
+inline constexpr auto kMinRun   = kBlock;               // keys of a sorted run, at least
+inline constexpr auto kMaxRuns  = std::size_t{16};      // visited runs before compaction
+inline constexpr auto kMaxFanIn = std::size_t{16};      // sets read at once by a merge
+
+// A file of keys. The file is removed with the run.
+struct Run {
+public:
+    Run() = default;
+    Run(fs::path path, std::size_t size) : path(std::move(path)), size(size) {}
+    Run(Run &&other) noexcept : path(std::exchange(other.path, {})), size(other.size) {}
+    auto operator=(Run &&other) noexcept -> Run & {
+        std::swap(path, other.path);
+        std::swap(size, other.size);
+        return *this;
+    }
+    ~Run() {
+        if (!path.empty()) {
+            auto ec = std::error_code{};
+            fs::remove(path, ec);
+        }
+    }
+
+    fs::path path;
+    std::size_t size = 0;
+};
+
+// A sequence of keys, sorted unless said otherwise: in memory while it fits in the
+// budget, or else spilled to a run on disk.
+struct StateSet {
+public:
+    StateSet() = default;
+    explicit StateSet(std::vector<Key> keys) : keys(std::move(keys)) {}
+    explicit StateSet(Run run) : run(std::move(run)) {}
+
+    auto on_disk() const -> bool {
+        return !run.path.empty();
+    }
+    auto size() const -> std::size_t {
+        return on_disk() ? run.size : keys.size();
+    }
+    // only for a set in memory
+    auto contains(Key key) const -> bool {
+        return std::ranges::binary_search(keys, key);
+    }
+
+    std::vector<Key> keys; // if in memory
+    Run run;               // if on disk
+};
+
+auto open_file(const fs::path &path, const char *mode) -> std::FILE * {
+    auto *file = std::fopen(path.c_str(), mode);
+    if (file == nullptr)
+        throw std::runtime_error(std::format("cannot open external run {}", path.string()));
+    return file;
+}
+
+// Keeps the keys in memory up to the limit, and then moves them all to the file
+struct SetWriter {
+public:
+    SetWriter(fs::path path, std::size_t limit) : path(std::move(path)), limit(limit) {}
+    SetWriter(SetWriter &&other) noexcept :
+        path(std::move(other.path)), limit(other.limit), file(std::exchange(other.file, nullptr)),
+        size(other.size), buffer(std::move(other.buffer)) {}
+    ~SetWriter() {
+        if (file != nullptr)
+            std::fclose(file);
+    }
+
+    auto push(Key key) -> void {
+        buffer.push_back(key);
+        if (file == nullptr ? buffer.size() > limit : buffer.size() == kBlock)
+            flush();
+    }
+
+    auto finish() -> StateSet {
+        if (file == nullptr)
+            return StateSet{std::move(buffer)};
+        flush();
+        std::fclose(std::exchange(file, nullptr));
+        return StateSet{Run{std::move(path), size}};
+    }
+
+private:
+    auto flush() -> void {
+        if (file == nullptr)
+            file = open_file(path, "wb");
+        const auto n = std::fwrite(buffer.data(), sizeof(Key), buffer.size(), file);
+        if (n != buffer.size())
+            throw std::runtime_error(std::format("cannot write external run {}", path.string()));
+        size += buffer.size();
+        buffer.clear();
+        if (buffer.capacity() > kBlock) { // the keys held before the spill
+            buffer.shrink_to_fit();
+            buffer.reserve(kBlock);
+        }
+    }
+
+    fs::path path;
+    std::size_t limit;
+    std::FILE *file  = nullptr;
+    std::size_t size = 0;
+    std::vector<Key> buffer;
+};
+
+// Reads a set from the given position on, from memory or by blocks from its run
+struct SetReader {
+public:
+    explicit SetReader(const StateSet &set, std::size_t offset = 0) {
+        if (!set.on_disk()) {
+            view = std::span{set.keys}.subspan(offset);
+            return;
+        }
+        file = open_file(set.run.path, "rb");
+        const auto position = static_cast<long>(offset * sizeof(Key));
+        if (std::fseek(file, position, SEEK_SET) != 0)
+            throw std::runtime_error(std::format("cannot seek run {}", set.run.path.string()));
+        buffer.reserve(kBlock);
+        fill();
+    }
+    SetReader(SetReader &&other) noexcept :
+        file(std::exchange(other.file, nullptr)), buffer(std::move(other.buffer)),
+        view(other.view), pos(other.pos) {}
+    ~SetReader() {
+        if (file != nullptr)
+            std::fclose(file);
+    }
+
+    auto empty() const -> bool {
+        return pos == view.size();
+    }
+
+    auto top() const -> Key {
+        return view[pos];
+    }
+
+    auto pop() -> void {
+        if (++pos == view.size() && file != nullptr)
+            fill();
+    }
+
+private:
+    auto fill() -> void {
+        buffer.resize(kBlock);
+        buffer.resize(std::fread(buffer.data(), sizeof(Key), kBlock, file));
+        view = buffer;
+        pos  = 0;
+    }
+
+    std::FILE *file = nullptr;
+    std::vector<Key> buffer;
+    std::span<const Key> view; // the keys in memory, or the block read last
+    std::size_t pos = 0;
+};
+
+// Owns a private directory for all the runs of one search
+struct Workspace {
+public:
+    Workspace(const fs::path &base, std::size_t limit) :
+        limit(limit), run(std::max(limit, kMinRun)) {
+        const auto root = base.empty() ? fs::temp_directory_path() : base;
+        auto random     = std::random_device{};
+        dir = root / std::format("ltl-external-{}-{}", random(), random());
+        fs::create_directories(dir);
+    }
+    ~Workspace() {
+        auto ec = std::error_code{};
+        fs::remove_all(dir, ec);
+    }
+
+    // a set kept in memory up to the budget
+    auto fresh() -> SetWriter {
+        return SetWriter{next_path(), limit};
+    }
+    // a set written to disk at once, whatever its size
+    auto spilled() -> SetWriter {
+        return SetWriter{next_path(), 0};
+    }
+
+    const std::size_t limit; // keys of a set kept in memory
+    // keys of a sorted run, or of a part in eliminate: not below kMinRun, so that a tiny
+    // budget does not cut the sets into thousands of files of a few KiB
+    const std::size_t run;
+
+private:
+    auto next_path() -> fs::path {
+        return dir / std::format("run-{}.bin", count++);
+    }
+
+    fs::path dir;
+    std::size_t count = 0;
+};
+
+// union of at most kMaxFanIn sorted sets, see merge
+auto merge_pass(Workspace &ws, std::span<const StateSet> sets, bool distinct) -> StateSet {
+    using Item  = std::pair<Key, std::size_t>;
+    auto heap   = std::priority_queue<Item, std::vector<Item>, std::greater<>>{};
+    auto inputs = std::vector<SetReader>{};
+    inputs.reserve(sets.size());
+    for (const auto &set : sets) {
+        inputs.emplace_back(set);
+        if (!inputs.back().empty())
+            heap.emplace(inputs.back().top(), inputs.size() - 1);
+    }
+    auto writer = ws.fresh();
+    auto last   = std::optional<Key>{};
+    while (!heap.empty()) {
+        const auto [key, i] = heap.top();
+        heap.pop();
+        if (!distinct || last != key)
+            writer.push(key);
+        last = key;
+        inputs[i].pop();
+        if (!inputs[i].empty())
+            heap.emplace(inputs[i].top(), i);
+    }
+    return writer.finish();
+}
+
+// union of sorted sets, the result is sorted, and deduplicated if distinct. With more
+// than kMaxFanIn sets, groups of them are merged first, so that few files are open.
+auto merge(Workspace &ws, std::span<const StateSet> sets, bool distinct = true) -> StateSet {
+    if (sets.size() <= kMaxFanIn)
+        return merge_pass(ws, sets, distinct);
+    auto merged = std::vector<StateSet>{};
+    for (auto i = std::size_t{}; i < sets.size(); i += kMaxFanIn) {
+        const auto group = sets.subspan(i, std::min(kMaxFanIn, sets.size() - i));
+        merged.push_back(merge_pass(ws, group, distinct));
+    }
+    return merge(ws, merged, distinct);
+}
+
+// keys of the set that (do not) appear in any of the other sets
+auto filter_by(
+    Workspace &ws, const StateSet &set, std::span<const StateSet> others, bool keep_common
+) -> StateSet {
+    auto inputs = std::vector<SetReader>{};
+    inputs.reserve(others.size());
+    for (const auto &other : others)
+        inputs.emplace_back(other);
+    auto writer = ws.fresh();
+    for (auto input = SetReader{set}; !input.empty(); input.pop()) {
+        const auto key = input.top();
+        auto found     = false;
+        for (auto &other : inputs) {
+            while (!other.empty() && other.top() < key)
+                other.pop();
+            found = found || (!other.empty() && other.top() == key);
+        }
+        if (found == keep_common)
+            writer.push(key);
+    }
+    return writer.finish();
+}
+
+// External sort: buffer keys in memory, and only once they exceed the run size, spill
+// sorted runs and merge them at last. Duplicates are dropped, unless not distinct.
+struct Sorter {
+public:
+    explicit Sorter(Workspace &ws, bool distinct = true) : ws(ws), distinct(distinct) {}
+
+    auto push(Key key) -> void {
+        buffer.push_back(key);
+        if (buffer.size() >= ws.run)
+            spill();
+    }
+
+    auto finish() -> StateSet {
+        if (runs.empty()) {
+            sort();
+            return StateSet{std::move(buffer)};
+        }
+        if (!buffer.empty())
+            spill();
+        if (runs.size() == 1)
+            return std::move(runs[0]);
+        return merge(ws, runs, distinct);
+    }
+
+private:
+    auto sort() -> void {
+        std::ranges::sort(buffer);
+        if (!distinct)
+            return;
+        const auto [first, last] = std::ranges::unique(buffer);
+        buffer.erase(first, last);
+    }
+
+    auto spill() -> void {
+        sort();
+        auto writer = ws.spilled();
+        for (const auto key : buffer)
+            writer.push(key);
+        runs.push_back(writer.finish());
+        buffer.clear();
+    }
+
+    Workspace &ws;
+    const bool distinct;
+    std::vector<Key> buffer;
+    std::vector<StateSet> runs;
+};
+
+template <typename _Set>
+struct ExternalProduct {
+public:
+    using NBA = BasicNBA<_Set>;
+
+    ExternalProduct(const LabelClasses &ts, const NBA &nba, const SearchOptions &options) :
+        ts(ts), nba(nba),
+        ws(options.external_dir, std::max<std::size_t>(options.memory_states, 1)) {}
+
+    // One-Way-Catch-Them-Young: alternately keep the states reachable from accepting
+    // states, and drop the states without predecessors. An accepting cycle exists
+    // iff the fixpoint is not empty.
+    auto can_run() -> bool {
+        auto set = explore(initial_states(), nullptr);
+        call_in_stats_mode([&] { query_stats().outer_visited += set.size(); });
+        while (set.size() != 0) {
+            const auto last = set.size();
+            set             = explore(accepting_states(set), &set);
+            set             = eliminate(set);
+            if (set.size() == last)
+                break;
+        }
+        return set.size() != 0;
+    }
+
+private:
+    auto encode(std::size_t idx_ts, std::size_t idx_nba) const -> Key {
+        return static_cast<Key>(idx_ts) * nba.num_states + idx_nba;
+    }
+
+    template <typename _Fn>
+    auto for_each_post(std::span<const LabelClasses::Group> groups, std::size_t idx_nba, _Fn &&fn)
+        const -> void {
+        for (const auto &group : groups)
+            if (auto *target = accept(nba, idx_nba, ts.label(group)))
+                for (const auto t : ts.states(group))
+                    for (const auto q : *target)
+                        fn(encode(t, q));
+    }
+
+    template <typename _Fn>
+    auto for_each_post(Key key, _Fn &&fn) const -> void {
+        const auto idx_ts  = static_cast<std::size_t>(key / nba.num_states);
+        const auto idx_nba = static_cast<std::size_t>(key % nba.num_states);
+        for_each_post(ts.post(idx_ts), idx_nba, fn);
+    }
+
+    auto initial_states() -> StateSet {
+        auto sorter = Sorter{ws};
+        for (const auto i : nba.initial_states)
+            for_each_post(ts.initial(), i, [&](Key key) { sorter.push(key); });
+        return sorter.finish();
+    }
+
+    // accepting states, except those whose TS state is on no cycle
+    auto accepting_states(const StateSet &set) -> StateSet {
+        auto writer = ws.fresh();
+        for (auto input = SetReader{set}; !input.empty(); input.pop()) {
+            const auto key = input.top();
+            if (nba.final_states[key % nba.num_states] && ts.on_cycle(key / nba.num_states))
+                writer.push(key);
+        }
+        return writer.finish();
+    }
+
+    // The states reachable from the seeds, within a set if any. A plain search with a
+    // hash set while the visited states fit in memory. Once they exceed the budget, they
+    // are spilled with those not expanded yet, and explore_on_disk goes on from there.
+    auto explore(StateSet seeds, const StateSet *within) -> StateSet {
+        if (seeds.on_disk() || (within != nullptr && within->on_disk()))
+            return explore_on_disk(std::move(seeds), within, {});
+        auto visited = std::unordered_set<Key>{seeds.keys.begin(), seeds.keys.end()};
+        auto pending = std::move(seeds.keys);
+        while (!pending.empty()) {
+            if (visited.size() > ws.limit) {
+                auto runs = std::vector<StateSet>{};
+                runs.push_back(sort_keys(visited));
+                return explore_on_disk(sort_keys(pending), within, std::move(runs));
+            }
+            const auto key = pending.back();
+            pending.pop_back();
+            for_each_post(key, [&](Key next) {
+                if ((within == nullptr || within->contains(next)) && visited.insert(next).second)
+                    pending.push_back(next);
+            });
+        }
+        auto result = std::vector<Key>(visited.begin(), visited.end());
+        std::ranges::sort(result);
+        return StateSet{std::move(result)};
+    }
+
+    // Level-synchronous BFS with delayed duplicate detection. The successors of a level
+    // are sorted externally and then subtracted from the visited levels on disk. A
+    // bounded hash set of recent states filters most duplicates before they are sorted.
+    auto explore_on_disk(StateSet frontier, const StateSet *within, std::vector<StateSet> visited)
+        -> StateSet {
+        auto recent = std::unordered_set<Key>{};
+        while (frontier.size() != 0) {
+            remember(recent, frontier);
+            auto sorter = Sorter{ws};
+            for (auto input = SetReader{frontier}; !input.empty(); input.pop())
+                for_each_post(input.top(), [&](Key key) {
+                    if (!recent.contains(key))
+                        sorter.push(key);
+                });
+            visited.push_back(std::move(frontier));
+            if (visited.size() > kMaxRuns)
+                visited = make_vector(merge(ws, visited));
+
+            auto candidates = sorter.finish();
+            if (within != nullptr)
+                candidates = filter_by(ws, candidates, {within, 1}, /*keep_common=*/true);
+            frontier = filter_by(ws, candidates, visited, /*keep_common=*/false);
+        }
+        return merge(ws, visited);
+    }
+
+    // A part of the set in eliminate: the positions [offset, offset + size) of its keys,
+    // from first to last, and their predecessor counts in the set, once counted
+    struct Part {
+        std::size_t offset;
+        std::size_t size;
+        Key first;
+        Key last;
+        StateSet counts;
+    };
+
+    // Drop the states without predecessors in the set, then those left without any, and
+    // so on. The set is cut into parts of at most a run (see Workspace), each processed
+    // in memory with the predecessor counts of its states, as in parallel.cpp, so that
+    // the drops propagate within a part at once. The decrements for other parts are sorted and
+    // applied in the next round, which is the only one when the set fits in memory.
+    auto eliminate(const StateSet &set) -> StateSet {
+        call_in_stats_mode([&] { query_stats().inner_visited += set.size(); });
+        auto parts = std::vector<Part>{};
+        for (auto input = SetReader{set}; !input.empty();) {
+            const auto offset = parts.empty() ? 0 : parts.back().offset + parts.back().size;
+            auto &part        = parts.emplace_back(Part{offset, 0, input.top(), input.top(), {}});
+            for (; !input.empty() && part.size < ws.run; input.pop(), ++part.size)
+                part.last = input.top();
+        }
+
+        // first the successors, which count the predecessors, then the decrements
+        auto successors = Sorter{ws, /*distinct=*/false};
+        for (auto input = SetReader{set}; !input.empty(); input.pop())
+            for_each_post(input.top(), [&](Key key) { successors.push(key); });
+        auto updates = successors.finish();
+        for (auto first = true; first || updates.size() != 0; first = false) {
+            auto decrements = Sorter{ws, /*distinct=*/false};
+            auto input      = SetReader{updates};
+            for (auto &part : parts) {
+                while (!input.empty() && input.top() < part.first)
+                    input.pop();
+                if (!first && (input.empty() || input.top() > part.last))
+                    continue;
+                update(set, part, input, first, parts.size() > 1, decrements);
+            }
+            updates = decrements.finish();
+        }
+
+        auto writer = ws.fresh();
+        for (const auto &part : parts) {
+            auto keys   = SetReader{set, part.offset};
+            auto counts = SetReader{part.counts};
+            for (auto i = std::size_t{}; i != part.size; ++i, keys.pop(), counts.pop())
+                if (counts.top() != 0)
+                    writer.push(keys.top());
+        }
+        return writer.finish();
+    }
+
+    // Apply the updates of a part, counting its predecessors first, or else decrementing
+    // them, and drop the states left without any, as far as the drops stay in the part.
+    // The successors of the dropped states in the other parts are decremented later.
+    auto update(
+        const StateSet &set, Part &part, SetReader &input, bool first, bool split,
+        Sorter &decrements
+    ) -> void {
+        auto keys = std::vector<Key>{};
+        keys.reserve(part.size);
+        for (auto reader = SetReader{set, part.offset}; keys.size() != part.size; reader.pop())
+            keys.push_back(reader.top());
+        auto counts = std::vector<Key>(part.size);
+        if (!first) {
+            auto reader = SetReader{part.counts};
+            for (auto &count : counts) {
+                count = reader.top();
+                reader.pop();
+            }
+        }
+
+        const auto position = [&](Key key) -> std::optional<std::size_t> {
+            const auto iter = std::ranges::lower_bound(keys, key);
+            if (iter == keys.end() || *iter != key)
+                return std::nullopt;
+            return static_cast<std::size_t>(iter - keys.begin());
+        };
+        auto dropped = std::vector<std::size_t>{};
+        for (; !input.empty() && input.top() <= part.last; input.pop())
+            if (const auto i = position(input.top())) {
+                if (first)
+                    ++counts[*i];
+                else if (--counts[*i] == 0)
+                    dropped.push_back(*i);
+            }
+        if (first)
+            for (const auto i : irange(part.size))
+                if (counts[i] == 0)
+                    dropped.push_back(i);
+        while (!dropped.empty()) {
+            const auto i = dropped.back();
+            dropped.pop_back();
+            for_each_post(keys[i], [&](Key key) {
+                if (key < part.first || key > part.last) {
+                    if (split)
+                        decrements.push(key);
+                } else if (const auto j = position(key); j && --counts[*j] == 0) {
+                    dropped.push_back(*j);
+                }
+            });
+        }
+
+        auto writer = split ? ws.spilled() : ws.fresh();
+        for (const auto count : counts)
+            writer.push(count);
+        part.counts = writer.finish();
+    }
+
+    auto remember(std::unordered_set<Key> &recent, const StateSet &set) const -> void {
+        if (recent.size() + set.size() > ws.limit)
+            recent.clear();
+        if (set.size() > ws.limit)
+            return;
+        for (auto input = SetReader{set}; !input.empty(); input.pop())
+            recent.insert(input.top());
+    }
+
+    auto sort_keys(const auto &keys) -> StateSet {
+        auto sorter = Sorter{ws};
+        for (const auto key : keys)
+            sorter.push(key);
+        return sorter.finish();
+    }
+
+    static auto make_vector(StateSet set) -> std::vector<StateSet> {
+        auto result = std::vector<StateSet>{};
+        result.push_back(std::move(set));
+        return result;
+    }
+
+    const LabelClasses &ts;
+    const NBA &nba;
+    Workspace ws;
+};
+
+} // namespace
+
+auto external_can_run(const LabelClasses &ts, const NBA &nba, const SearchOptions &options)
+    -> bool {
+    return nba.visit([&]<typename _Set>(const BasicNBA<_Set> &nba) {
+        auto product = ExternalProduct<_Set>{ts, nba, options};
+        return product.can_run();
+    });
+}
+
+} // namespace dark
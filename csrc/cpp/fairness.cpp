@@ -0,0 +1,348 @@
+#include "LTL/automa.h"
+#include "LTL/error.h"
+#include "LTL/stats.h"
+#include "LTL/ts.h"
+#include "product.h"
+#include "utils/irange.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dark {
+
+auto Fairness::is_taken(std::size_t from, std::size_t into) const -> bool {
+    return std::ranges::binary_search(taken[from], into);
+}
+
+namespace {
+
+inline constexpr auto kNone = static_cast<std::size_t>(-1);
+
+// A graph whose vertices each stand for a TS state, with successors as compressed rows
+struct FairGraph {
+public:
+    auto size() const -> std::size_t {
+        return states.size();
+    }
+
+    auto successors(std::size_t v) const -> std::span<const std::size_t> {
+        return {targets.begin() + offsets[v], targets.begin() + offsets[v + 1]};
+    }
+
+    std::vector<std::size_t> states;     // vertex -> TS state
+    std::vector<std::uint8_t> accepting; // vertex -> whether a fair cycle may go through it
+    std::vector<std::size_t> offsets{0}; // vertex -> range of targets
+    std::vector<std::size_t> targets;    // successors of the vertices, by rows
+};
+
+// Call fn on the vertices of each fair SCC of the graph, until it returns true, and tell
+// whether it did. A fair SCC has a cycle through an accepting vertex, and for each
+// assumption, an edge taking it or else no vertex enabling it (strong), or some vertex
+// not enabling it (weak). An SCC with no accepting vertex, or all of whose vertices enable
+// a weak assumption never taken in it, has no fair subgraph either, so it is dropped.
+// Otherwise, the vertices enabling a strong assumption never taken in it can be on no
+// fair cycle, so they are dropped, and the rest is split into SCCs again, as in the
+// emptiness check of Streett automata. Each round drops a vertex, so there are at most
+// as many rounds as vertices, and a fairness assumption costs no automaton states.
+template <typename _Fn>
+auto for_each_fair_scc(const FairGraph &graph, std::span<const Fairness> fairness, _Fn &&fn)
+    -> bool {
+    struct Frame {
+        std::size_t vertex;
+        std::size_t next; // index of the next successor to visit
+    };
+
+    const auto n = graph.size();
+    auto part    = std::vector<std::size_t>(n, 0); // vertex -> subgraph, kNone once dropped
+    auto index   = std::vector<std::size_t>(n, kNone);
+    auto low     = std::vector<std::size_t>(n);
+    auto bad     = std::vector<std::uint8_t>(n);
+    auto stack   = std::vector<std::size_t>{};
+    auto frames  = std::vector<Frame>{};
+    auto scc     = std::vector<std::size_t>{};
+    auto pending = std::vector<std::vector<std::size_t>>{}; // subgraphs to split into SCCs
+    auto parts   = std::size_t{1};
+    auto counter = std::size_t{};
+
+    // whether an edge within the SCC, numbered id, takes the assumption
+    const auto is_taken = [&](const Fairness &f, std::size_t id) {
+        return std::ranges::any_of(scc, [&](std::size_t v) {
+            return std::ranges::any_of(graph.successors(v), [&](std::size_t w) {
+                return part[w] == id && f.is_taken(graph.states[v], graph.states[w]);
+            });
+        });
+    };
+
+    // the SCC just completed, which either is fair, or is dropped in part or as a whole
+    const auto settle = [&]() -> bool {
+        const auto id = parts++;
+        for (const auto v : scc)
+            part[v] = id;
+        const auto drop = [&] {
+            for (const auto v : scc) {
+                part[v] = kNone;
+                bad[v]  = 0;
+            }
+            return false;
+        };
+        const auto self_loop = [&](std::size_t v) {
+            return std::ranges::find(graph.successors(v), v) != graph.successors(v).end();
+        };
+        if (scc.size() == 1 && !self_loop(scc[0]))
+            return drop();
+        if (std::ranges::none_of(scc, [&](std::size_t v) { return graph.accepting[v]; }))
+            return drop();
+        auto fair = true;
+        for (const auto &f : fairness) {
+            const auto enabled = [&](std::size_t v) { return f.enabled[graph.states[v]] != 0; };
+            switch (f.kind) {
+                case Fairness::Kind::Weak:
+                    if (std::ranges::all_of(scc, enabled) && !is_taken(f, id))
+                        return drop();
+                    break;
+                case Fairness::Kind::Strong:
+                    if (std::ranges::any_of(scc, enabled) && !is_taken(f, id)) {
+                        for (const auto v : scc)
+                            bad[v] = bad[v] || enabled(v);
+                        fair = false;
+                    }
+                    break;
+                default: panic("Invalid fairness kind");
+            }
+        }
+        if (fair)
+            return fn(std::span<const std::size_t>{scc}) || drop();
+        auto rest = std::vector<std::size_t>{};
+        for (const auto v : scc) {
+            if (bad[v])
+                part[v] = kNone;
+            else
+                rest.push_back(v);
+            bad[v] = 0;
+        }
+        if (!rest.empty())
+            pending.push_back(std::move(rest));
+        return false;
+    };
+
+    const auto enter = [&](std::size_t v) {
+        index[v] = low[v] = counter++;
+        stack.push_back(v);
+        frames.push_back({v, 0});
+    };
+
+    if (n == 0)
+        return false;
+    pending.emplace_back(n);
+    std::iota(pending.back().begin(), pending.back().end(), std::size_t{});
+    while (!pending.empty()) {
+        const auto members = std::move(pending.back());
+        pending.pop_back();
+        const auto p = part[members.front()];
+        for (const auto v : members)
+            index[v] = kNone;
+        call_in_stats_mode([&] { query_stats().inner_visited += members.size(); });
+
+        // Tarjan on the subgraph, whose vertices leave it as soon as their SCC is done
+        counter = 0;
+        for (const auto root : members) {
+            if (part[root] != p || index[root] != kNone)
+                continue;
+            enter(root);
+            while (!frames.empty()) {
+                const auto v    = frames.back().vertex;
+                const auto next = graph.successors(v);
+                if (frames.back().next < next.size()) {
+                    const auto w = next[frames.back().next++];
+                    if (part[w] != p)
+                        continue;
+                    if (index[w] == kNone)
+                        enter(w);
+                    else
+                        low[v] = std::min(low[v], index[w]);
+                    continue;
+                }
+                frames.pop_back();
+                if (!frames.empty()) {
+                    const auto u = frames.back().vertex;
+                    low[u]       = std::min(low[u], low[v]);
+                }
+                if (low[v] != index[v])
+                    continue;
+                scc.clear();
+                auto w = kNone;
+                do {
+                    w = stack.back();
+                    stack.pop_back();
+                    scc.push_back(w);
+                } while (w != v);
+                if (settle())
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+// product state (idx_ts, idx_nba), encoded as idx_ts * nba.num_states + idx_nba
+using Key = std::uint64_t;
+
+// the key space up to which vertices are looked up in a flat table, not a hash map
+inline constexpr auto kMaxDense = Key{1} << 24; // 128 MiB of ids
+
+// the reachable product, numbered in BFS order
+template <typename _Set>
+auto fair_product(const LabelClasses &ts, const BasicNBA<_Set> &nba) -> FairGraph {
+    const auto num_keys = static_cast<Key>(ts.num_states) * nba.num_states;
+    auto graph          = FairGraph{};
+    auto dense          = std::vector<std::size_t>(num_keys <= kMaxDense ? num_keys : 0, kNone);
+    auto ids            = std::unordered_map<Key, std::size_t>{};
+    auto keys           = std::vector<Key>{};
+    const auto id_of    = [&](Key key) {
+        if (!dense.empty()) {
+            if (dense[key] == kNone) {
+                dense[key] = keys.size();
+                keys.push_back(key);
+            }
+            return dense[key];
+        }
+        const auto [it, inserted] = ids.try_emplace(key, keys.size());
+        if (inserted)
+            keys.push_back(key);
+        return it->second;
+    };
+    const auto visit = [&](std::span<const LabelClasses::Group> groups, std::size_t idx_nba) {
+        for (const auto &group : groups)
+            if (auto *target = accept(nba, idx_nba, ts.label(group)))
+                for (const auto t : ts.states(group))
+                    for (const auto q : *target)
+                        graph.targets.push_back(id_of(static_cast<Key>(t) * nba.num_states + q));
+    };
+
+    for (const auto i : nba.initial_states)
+        visit(ts.initial(), i);
+    graph.targets.clear(); // the edges from the virtual entry state are not kept
+    for (auto v = std::size_t{}; v < keys.size(); ++v) {
+        const auto idx_ts  = static_cast<std::size_t>(keys[v] / nba.num_states);
+        const auto idx_nba = static_cast<std::size_t>(keys[v] % nba.num_states);
+        visit(ts.post(idx_ts), idx_nba);
+        graph.offsets.push_back(graph.targets.size());
+        graph.states.push_back(idx_ts);
+        graph.accepting.push_back(nba.final_states[idx_nba] && ts.on_cycle(idx_ts));
+    }
+    call_in_stats_mode([&] { query_stats().outer_visited += keys.size(); });
+    return graph;
+}
+
+} // namespace
+
+auto fair_can_run(const LabelClasses &ts, const NBA &nba) -> bool {
+    return nba.visit([&]<typename _Set>(const BasicNBA<_Set> &nba) {
+        const auto graph = fair_product(ts, nba);
+        return for_each_fair_scc(graph, ts.fairness, [](std::span<const std::size_t>) {
+            return true;
+        });
+    });
+}
+
+auto TSGraph::read_fairness(std::istream &is) -> void {
+    auto line = std::string{};
+    while (std::getline(is, line)) {
+        auto ss    = std::stringstream{line};
+        auto words = std::vector<std::string>{std::istream_iterator<std::string>{ss}, {}};
+        if (words.empty())
+            continue;
+        docheck(words.size() == 2 || words.size() == 3, "invalid fairness: {}", line);
+        auto &f = fairness.emplace_back();
+        if (words[0] == "weak")
+            f.kind = Fairness::Kind::Weak;
+        else if (words[0] == "strong")
+            f.kind = Fairness::Kind::Strong;
+        else
+            docheck(false, "unknown fairness kind: {}", words[0]);
+        f.enabled.assign(num_states, 0);
+        f.taken.assign(num_states, {});
+
+        if (words.size() == 2) {
+            const auto iter = std::ranges::find(action_map, words[1]);
+            docheck(iter != action_map.end(), "Unknown action: {}", words[1]);
+            const auto action = static_cast<std::size_t>(iter - action_map.begin());
+            for (const auto &[from, a, into] : transitions) {
+                if (a != action)
+                    continue;
+                f.enabled[from] = 1;
+                f.taken[from].push_back(into);
+            }
+            for (auto &list : f.taken) {
+                std::ranges::sort(list);
+                const auto [first, last] = std::ranges::unique(list);
+                list.erase(first, last);
+            }
+        } else {
+            // nullopt for true, which holds everywhere
+            const auto atomic = [this](const std::string &name) -> std::optional<std::size_t> {
+                if (name == "true")
+                    return std::nullopt;
+                return map_atomic(name);
+            };
+            const auto holds = [this](std::optional<std::size_t> ap, std::size_t state) {
+                return !ap.has_value() || ap_sets[state][*ap];
+            };
+            const auto enabled = atomic(words[1]);
+            const auto taken   = atomic(words[2]);
+            for (const auto v : irange(num_states)) {
+                f.enabled[v] = holds(enabled, v);
+                for (const auto w : transition_list[v])
+                    if (holds(taken, w))
+                        f.taken[v].push_back(w);
+            }
+        }
+    }
+    if (fairness.empty())
+        return;
+
+    // a fair path starts where a fair SCC of the TS can be reached, the same for a whole SCC
+    auto graph = FairGraph{};
+    auto preds = std::vector<std::vector<std::size_t>>(num_states);
+    for (const auto v : irange(num_states)) {
+        for (const auto w : transition_list[v]) {
+            graph.targets.push_back(w);
+            preds[w].push_back(v);
+        }
+        graph.offsets.push_back(graph.targets.size());
+        graph.states.push_back(v);
+        graph.accepting.push_back(1);
+    }
+    auto live     = std::vector<std::uint8_t>(num_states);
+    auto frontier = std::vector<std::size_t>{};
+    for_each_fair_scc(graph, fairness, [&](std::span<const std::size_t> scc) {
+        for (const auto v : scc) {
+            live[v] = 1;
+            frontier.push_back(v);
+        }
+        return false;
+    });
+    while (!frontier.empty()) {
+        const auto w = frontier.back();
+        frontier.pop_back();
+        for (const auto v : preds[w])
+            if (!live[v]) {
+                live[v] = 1;
+                frontier.push_back(v);
+            }
+    }
+    std::ranges::fill(scc_live, 0);
+    for (const auto v : irange(num_states))
+        scc_live[scc_index[v]] = scc_live[scc_index[v]] || live[v];
+}
+
+} // namespace dark
@@ -2,44 +2,61 @@
 #include "LTL/error.h"
 #include "LTL/node.h"
 #include "LTL/node_impl.h"
+#include "LTL/stats.h"
 #include "gnba_aux.h"
 #include "utils/bitset.h"
 #include "utils/error.h"
 #include "utils/irange.h"
+#include "utils/thread_pool.h"
+#include <algorithm>
+#include <concepts>
 #include <cstddef>
 #include <format>
+#include <iterator>
+#include <numeric>
 #include <optional>
 #include <ostream>
 #include <span>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
-#include <unordered_set>
 #include <utility>
+#include <variant>
 #include <vector>
 
 namespace dark {
 
 namespace {
 
-struct formula_bitset : private bitset {
-    using bitset::bitset;
-    using bitset::subset;
-    using bitset::to_string;
-    using bitset::operator[];
-    using bitset::size;
+// _Bits is wide enough for all the formulas, see dispatch_bitset
+template <typename _Bits>
+struct formula_bitset : private _Bits {
+    using _Bits::_Bits;
+    using _Bits::to_string;
+    using _Bits::operator[];
+    using _Bits::size;
     auto operator[](fid f) const -> bool {
         if (f.is_negation())
             return f == fid::False ? false : !(*this)[(~f).raw()];
         else
             return f == fid::True ? true : (*this)[f.raw()];
     }
-    auto as_bitset() const -> const bitset & {
+    auto as_bitset() const -> const _Bits & {
         return *this;
     }
+    // the first num_ap formulas (i.e. the APs), as a trigger of the automaton
+    auto trigger(std::size_t num_ap) const -> bitset {
+        if constexpr (std::same_as<_Bits, bitset>) {
+            return _Bits::subset(num_ap);
+        } else {
+            auto result = bitset{num_ap};
+            for (const auto i : irange(num_ap))
+                result[i] = (*this)[i];
+            return result;
+        }
+    }
 };
 
-using fset = formula_bitset;
-
 struct FormulaCollector {
     auto get_formulas() const -> std::span<const Formula> {
         return formulas;
@@ -47,8 +64,12 @@ struct FormulaCollector {
 
     auto map(BaseNode *node) const -> fid {
         // for atomic node, we can directly figure out its index
-        if (auto ptr = node->is<AtomicNode>())
-            return fid(ptr->index);
+        if (auto ptr = node->is<AtomicNode>()) {
+            using enum AtomicNode::Type;
+            return ptr->type == True    ? fid::True
+                   : ptr->type == False ? fid::False
+                                        : fid(ptr->index);
+        }
         auto iter = mapping.find(node);
         assume(iter != mapping.end(), "Node not found, call build first");
         return iter->second;
@@ -150,8 +171,11 @@ auto debug_check_formula(std::span<const Formula> formulas, std::size_t num_ap)
     }
 }
 
+template <typename _Bits>
 struct SetBuilder {
 public:
+    using fset = formula_bitset<_Bits>;
+
     struct PrettyInfo {
         std::vector<std::string> name;
         auto nameof(const fid f) const -> std::string {
@@ -162,8 +186,9 @@ public:
         }
     };
 
-    static auto from(std::span<const Formula> formulas, std::size_t num_aps) -> SetBuilder {
-        auto builder = SetBuilder{formulas, num_aps};
+    static auto from(std::span<const Formula> formulas, std::size_t num_aps, fid root)
+        -> SetBuilder {
+        auto builder = SetBuilder{formulas, num_aps, root};
         builder.build();
         return builder;
     }
@@ -179,19 +204,29 @@ public:
     }
 
 private:
-    SetBuilder(std::span<const Formula> formulas, std::size_t num_aps) :
-        formulas(formulas), num_aps(num_aps) {}
+    SetBuilder(std::span<const Formula> formulas, std::size_t num_aps, fid root) :
+        formulas(formulas), num_aps(num_aps), root(root) {}
 
     // hidden build function
     auto build() -> void;
 
-    // prepare the indices for the set
-    auto prepare() -> std::vector<std::size_t>;
+    // assign the variables in [pos, last), pushing the sets to out, see build.
+    // return the number of partial sets explored
+    auto enumerate(
+        std::span<const std::size_t> aps, fset &set, std::size_t pos, std::size_t last,
+        std::vector<fset> &out
+    ) const -> std::size_t;
+
+    // find the APs used by the root or by an operand of some formula
+    auto prepare() -> void;
 
     // whether the set is an elementary set. if so, return the full bitset
     // the given set already define whether the ap/given formula is true or false
     auto check(fset) const -> std::optional<fset>;
 
+    // a subtree of the search runs on a thread only if it has at least so many levels
+    inline static constexpr auto kMinSubtreeDepth = std::size_t{8};
+
     // finally accepted sets
     std::vector<fset> sets;
 
@@ -201,35 +236,29 @@ private:
     // common parameters
     const std::span<const Formula> formulas;
     const std::size_t num_aps;
+    const fid root; // the formula itself, which may be an AP
 };
 
-auto SetBuilder::prepare() -> std::vector<std::size_t> {
+template <typename _Bits>
+auto SetBuilder<_Bits>::prepare() -> void {
     used_ap         = bitset{num_aps};
-    auto indice_set = std::unordered_set<std::size_t>{};
-    auto try_add_ap = [this, &indice_set](fid f) {
+    auto try_add_ap = [this](fid f) {
         const auto n = f.original();
-        if (n < num_aps) {
-            indice_set.insert(n);
+        if (n < num_aps)
             used_ap[n] = true;
-        }
     };
 
-    // extract all the ap in the subformula and those uncertain
-    // formulas (i.e., next and until), which will also be taken
-    // into account when we enumerate the sets
+    try_add_ap(root);
     for (const auto i : irange(num_aps, formulas.size())) {
         const auto &f = formulas[i];
         try_add_ap(f[0]);
         if (f.is_binary())
             try_add_ap(f[1]);
-        if (f.is_uncertain())
-            indice_set.insert(i);
     }
-
-    return {indice_set.begin(), indice_set.end()};
 }
 
-auto SetBuilder::check(fset set) const -> std::optional<fset> {
+template <typename _Bits>
+auto SetBuilder<_Bits>::check(fset set) const -> std::optional<fset> {
     for (const auto i : irange(num_aps, formulas.size())) {
         const auto &f = formulas[i];
         assume(!f.is_atomic(), "Atomic formula should not be here");
@@ -251,21 +280,113 @@ auto SetBuilder::check(fset set) const -> std::optional<fset> {
     return set;
 }
 
-auto SetBuilder::build() -> void {
-    const auto indices = prepare();
-    const auto size    = indices.size();
-    assume(size < 32, "Too many indices to enumerate, stop here");
-    auto current_bitset = fset{formulas.size()};
-    // enumerate all AP and uncertain formulas
-    for (const auto i : irange(std::size_t{1} << size)) {
-        for (const auto j : irange(size))
-            current_bitset[indices[j]] = (i >> j) & 1;
-        if (auto result = check(current_bitset))
-            sets.push_back(std::move(*result));
+// Depth-first over the variables: the used APs, then the formulas in index order, so that
+// the operands of a formula are set before it. The APs and next formulas branch freely,
+// a conjunction follows from its operands, and an until formula is forced unless only its
+// lhs holds. No branch is ever rejected, so the time is linear in the elementary sets.
+template <typename _Bits>
+auto SetBuilder<_Bits>::enumerate(
+    std::span<const std::size_t> aps, fset &set, std::size_t pos, std::size_t last,
+    std::vector<fset> &out
+) const -> std::size_t {
+    // a partial set is counted once, where it is either expanded or complete
+    if (pos == last) {
+        out.push_back(set);
+        return pos == aps.size() + formulas.size() - num_aps;
+    }
+    auto explored     = std::size_t{1};
+    const auto branch = [&](std::size_t i) {
+        for (const auto value : {false, true}) {
+            set[i]   = value;
+            explored += enumerate(aps, set, pos + 1, last, out);
+        }
+        return explored;
+    };
+    if (pos < aps.size())
+        return branch(aps[pos]);
+
+    const auto i  = num_aps + (pos - aps.size());
+    const auto &f = formulas[i];
+    if (f.is_conj()) {
+        set[i] = set[f[0]] && set[f[1]];
+        return explored + enumerate(aps, set, pos + 1, last, out);
+    }
+    if (f.is_until() && (set[f[1]] || !set[f[0]])) {
+        set[i] = set[f[1]];
+        return explored + enumerate(aps, set, pos + 1, last, out);
     }
+    return branch(i);
 }
 
-auto SetBuilder::debug(std::ostream &os) const -> PrettyInfo {
+template <typename _Bits>
+auto SetBuilder<_Bits>::build() -> void {
+    prepare();
+    auto aps = std::vector<std::size_t>{};
+    for (const auto i : irange(num_aps))
+        if (used_ap[i])
+            aps.push_back(i);
+    const auto num_vars = aps.size() + formulas.size() - num_aps;
+
+    // With several threads, the top of the search is expanded level by level, until
+    // there are enough subtrees for the chunks. The levels keep the depth-first order,
+    // and the chunks are concatenated in order, so the sets are numbered the same way.
+    auto &pool            = ThreadPool::global();
+    const auto num_chunks = pool.size() * kChunksPerThread;
+    auto frontier         = std::vector<fset>{fset{formulas.size()}};
+    auto depth            = std::size_t{};
+    auto explored         = std::size_t{};
+    while (pool.size() > 1 && frontier.size() < num_chunks &&
+           depth + kMinSubtreeDepth <= num_vars) {
+        auto next = std::vector<fset>{};
+        for (auto &set : frontier)
+            explored += enumerate(aps, set, depth, depth + 1, next);
+        frontier = std::move(next);
+        ++depth;
+    }
+
+    if (frontier.size() < num_chunks) {
+        for (auto &set : frontier)
+            explored += enumerate(aps, set, depth, num_vars, sets);
+    } else {
+        auto chunks = std::vector<std::vector<fset>>(num_chunks);
+        auto counts = std::vector<std::size_t>(num_chunks);
+        pool.run(num_chunks, [&](std::size_t c) {
+            for (const auto j : chunk_of(c, num_chunks, frontier.size()))
+                counts[c] += enumerate(aps, frontier[j], depth, num_vars, chunks[c]);
+        });
+        for (auto &chunk : chunks)
+            std::ranges::move(chunk, std::back_inserter(sets));
+        explored += std::reduce(counts.begin(), counts.end());
+    }
+    call_in_stats_mode([&] {
+        query_stats().set_candidates += explored;
+        query_stats().set_accepted   += sets.size();
+    });
+
+    call_in_debug_mode([&] {
+        for (const auto &set : sets)
+            assume(check(set).has_value(), "Invalid elementary set");
+        // the brute force over the APs and uncertain formulas (next and until) accepts
+        // as many sets
+        auto indices = aps;
+        for (const auto i : irange(num_aps, formulas.size()))
+            if (formulas[i].is_uncertain())
+                indices.push_back(i);
+        if (indices.size() > 16)
+            return;
+        auto count     = std::size_t{};
+        auto candidate = fset{formulas.size()};
+        for (const auto i : irange(std::size_t{1} << indices.size())) {
+            for (const auto j : irange(indices.size()))
+                candidate[indices[j]] = (i >> j) & 1;
+            count += check(candidate).has_value();
+        }
+        assume(count == sets.size(), "Elementary sets mismatch");
+    });
+}
+
+template <typename _Bits>
+auto SetBuilder<_Bits>::debug(std::ostream &os) const -> PrettyInfo {
     // first of all print all the formula
     os << std::format("Number of atomic propositions: {}\n", num_aps);
     os << std::format("Number of formulas: {}\n", formulas.size());
@@ -308,8 +429,11 @@ auto SetBuilder::debug(std::ostream &os) const -> PrettyInfo {
     return display;
 }
 
+template <typename _Bits>
 struct VisitHelper {
 public:
+    using fset = formula_bitset<_Bits>;
+
     VisitHelper(std::size_t num_aps, std::span<const Formula> formulas) :
         num_aps(num_aps), formulas(formulas) {}
 
@@ -321,17 +445,18 @@ public:
     }
 
 private:
-    bitset require;
-    bitset indices;
+    _Bits require;
+    _Bits indices;
     bool early_reject;
 
     const std::size_t num_aps;
     const std::span<const Formula> formulas;
 };
 
-auto VisitHelper::build(const fset &x) -> void {
-    bitset new_r{formulas.size()};
-    bitset new_i{formulas.size()};
+template <typename _Bits>
+auto VisitHelper<_Bits>::build(const fset &x) -> void {
+    _Bits new_r{formulas.size()};
+    _Bits new_i{formulas.size()};
     auto insert = [&new_r, &new_i, this](std::size_t idx, bool value) {
         if (new_i[idx] && new_r[idx] != value) {
             // conflicting requirement
@@ -348,10 +473,12 @@ auto VisitHelper::build(const fset &x) -> void {
         const auto &f = formulas[i];
         assume(!f.is_atomic(), "Atomic formula should not be here");
         if (f.is_next()) {
-            if (f[0] == fid::True)
-                continue; // nothing to do
-            if (f[0] == fid::False)
-                early_reject = true;
+            // x[i] = y[f[0]], a constant for next true and next false
+            if (f[0] == fid::True || f[0] == fid::False) {
+                if (x[i] != (f[0] == fid::True))
+                    early_reject = true;
+                continue;
+            }
 
             // x[i] = y[f[0]]
             insert(f[0].original(), f[0].is_negation() ^ x[i]);
@@ -374,34 +501,29 @@ auto VisitHelper::build(const fset &x) -> void {
     this->indices = std::move(new_i);
 }
 
-auto VisitHelper::accept(const fset &f) const -> bool {
+template <typename _Bits>
+auto VisitHelper<_Bits>::accept(const fset &f) const -> bool {
     return !early_reject && (f.as_bitset() & indices) == require;
 }
 
-} // namespace
+// Build the GNBA from the elementary sets, with _Set wide enough for its states
+template <typename _Set, typename _Bits>
+auto make_gnba(
+    BaseNode *ptr, std::size_t num_ap, const FormulaCollector &collector,
+    const SetBuilder<_Bits> &builder, bool negate
+) -> BasicGNBA<_Set> {
+    using fset    = formula_bitset<_Bits>;
+    using EdgeMap = typename BasicAutoma<_Set>::EdgeMap;
 
-// Transform an LTL formula into a GNBA
-auto GNBA::build(BaseNode *ptr, std::size_t num_atomics, bool negate) -> GNBA {
-    const auto num_ap = num_atomics;
-    docheck(num_ap > 0, "There must be at least 1 atomic proposition");
-
-    // Now we have abstract the formula into structures
-    const auto collector = FormulaCollector::from(ptr, num_ap);
-    const auto formulas  = collector.get_formulas();
-    debug_check_formula(formulas, num_ap);
-
-    // First, find all the elementary set of the formulas
-    const auto builder = SetBuilder::from(formulas, num_ap);
-
-    const auto sets = builder.elementary_sets();
-    const auto size = sets.size(); // the size of the GNBA
-    const auto root = negate ? ~collector.map(ptr) : collector.map(ptr);
+    const auto formulas = collector.get_formulas();
+    const auto sets     = builder.elementary_sets();
+    const auto size     = sets.size(); // the size of the GNBA
+    const auto root     = negate ? ~collector.map(ptr) : collector.map(ptr);
 
     auto make_initial = [&] {
-        auto initial   = bitset{size};
-        const auto idx = root.original();
+        auto initial = _Set{size};
         for (const auto i : irange(size))
-            if (sets[i][idx] != root.is_negation())
+            if (sets[i][root])
                 initial[i] = true; // if negation, require false (not in set)
         return initial;
     };
@@ -429,36 +551,44 @@ auto GNBA::build(BaseNode *ptr, std::size_t num_atomics, bool negate) -> GNBA {
         return true;
     };
 
+    // the rows are independent, so chunks of them are built on the threads.
+    // a few rows are cheaper to build than to hand out.
     auto make_transition = [&] {
-        auto transition = std::vector<EdgeMap>(size);
-        auto visit_aux  = VisitHelper{num_ap, formulas};
-        for (const auto i : irange(size)) {
-            const auto &s = sets[i];
-            auto trigger  = s.subset(num_ap);
-            auto targets  = bitset{size};
-            visit_aux.build(s);
-            if (!visit_aux.always_reject()) {
-                for (const auto j : irange(size))
-                    if (visit_aux.accept(sets[j]))
-                        targets[j] = true;
+        static constexpr auto kParallelSize = std::size_t{512};
+
+        auto transition       = std::vector<EdgeMap>(size);
+        auto &pool            = ThreadPool::global();
+        const auto num_chunks = size < kParallelSize ? 1 : pool.size() * kChunksPerThread;
+        pool.run(num_chunks, [&](std::size_t c) {
+            auto visit_aux = VisitHelper<_Bits>{num_ap, formulas};
+            for (const auto i : chunk_of(c, num_chunks, size)) {
+                const auto &s = sets[i];
+                auto trigger  = s.trigger(num_ap);
+                auto targets  = _Set{size};
+                visit_aux.build(s);
+                if (!visit_aux.always_reject()) {
+                    for (const auto j : irange(size))
+                        if (visit_aux.accept(sets[j]))
+                            targets[j] = true;
+                }
+                call_in_debug_mode([&] {
+                    for (const auto j : irange(size))
+                        assume(can_visit(s, sets[j]) == targets[j], "Invalid transition");
+                    if (visit_aux.always_reject())
+                        assume(targets.none(), "Invalid transition");
+                });
+                transition[i] = {{trigger, targets}};
             }
-            call_in_debug_mode([&] {
-                for (const auto j : irange(size))
-                    assume(can_visit(s, sets[j]) == targets[j], "Invalid transition");
-                if (visit_aux.always_reject())
-                    assume(targets.none(), "Invalid transition");
-            });
-            transition[i] = {{trigger, targets}};
-        }
+        });
         return transition;
     };
 
     auto make_final = [&] {
-        auto final = std::vector<bitset>{};
+        auto final = std::vector<_Set>{};
         for (const auto i : irange(num_ap, formulas.size())) {
             const auto &f = formulas[i];
             if (f.is_until()) {
-                auto final_set = bitset{size};
+                auto final_set = _Set{size};
                 for (const auto j : irange(size))
                     if (!sets[j][i] || sets[j][f[1]])
                         final_set[j] = true;
@@ -468,8 +598,8 @@ auto GNBA::build(BaseNode *ptr, std::size_t num_atomics, bool negate) -> GNBA {
         return final;
     };
 
-    auto result                   = GNBA();
-    static_cast<Automa &>(result) = Automa{
+    auto result                          = BasicGNBA<_Set>();
+    static_cast<BasicAutoma<_Set> &>(result) = BasicAutoma<_Set>{
         .num_states     = size,
         .num_triggers   = num_ap,
         .initial_states = make_initial(),
@@ -484,7 +614,7 @@ auto GNBA::build(BaseNode *ptr, std::size_t num_atomics, bool negate) -> GNBA {
             auto os = debugger();
             return builder.debug(os);
         }();
-        auto to_indice = [](const bitset &b) {
+        auto to_indice = [](const auto &b) {
             std::string result = "{ ";
             for (const auto i : b)
                 result += std::to_string(i) + ' ';
@@ -497,7 +627,7 @@ auto GNBA::build(BaseNode *ptr, std::size_t num_atomics, bool negate) -> GNBA {
         for (const auto i : irange(size)) {
             auto os = debugger();
             os << "State " << i << ": ";
-            for (const auto [trigger, target] : result.transitions[i])
+            for (const auto &[trigger, target] : result.transitions[i])
                 os << to_indice(trigger) << " -> " << to_indice(target);
             os << '\n';
         }
@@ -509,4 +639,36 @@ auto GNBA::build(BaseNode *ptr, std::size_t num_atomics, bool negate) -> GNBA {
     return result;
 }
 
+} // namespace
+
+// Transform an LTL formula into a GNBA
+auto GNBA::build(BaseNode *ptr, std::size_t num_atomics, bool negate) -> GNBA {
+    const auto num_ap = num_atomics;
+    docheck(num_ap > 0, "There must be at least 1 atomic proposition");
+
+    // Now we have abstract the formula into structures
+    const auto collector = FormulaCollector::from(ptr, num_ap);
+    const auto formulas  = collector.get_formulas();
+    debug_check_formula(formulas, num_ap);
+
+    // a formula set holds one bit per formula
+    auto result = dispatch_bitset(formulas.size(), [&]<typename _Bits>(std::type_identity<_Bits>) {
+        // First, find all the elementary set of the formulas
+        const auto builder = SetBuilder<_Bits>::from(formulas, num_ap, collector.map(ptr));
+
+        // a state set must also hold the states of the NBA, one copy per final set
+        const auto num_final = std::ranges::count_if(formulas, &Formula::is_until);
+        const auto width = builder.elementary_sets().size() * std::max<std::size_t>(num_final, 1);
+        return dispatch_bitset(width, [&]<typename _Set>(std::type_identity<_Set>) {
+            return GNBA{make_gnba<_Set>(ptr, num_ap, collector, builder, negate)};
+        });
+    });
+    // decide before trimming, which drops the states only the other polarity starts from
+    result.satisfiability = result.visit([negate](const auto &gnba) {
+        return gnba.decide(negate);
+    });
+    std::visit([](auto &gnba) { gnba.trim(); }, result.impl);
+    return result;
+}
+
 } // namespace dark
@@ -1,22 +1,28 @@
+#include "LTL/context.h"
 #include "LTL/error.h"
 #include "LTL/input.h"
 #include "LTL/node.h"
 #include "LTL/node_impl.h"
+#include "LTL/stats.h"
 #include "LTL/ts.h"
 #include "LTLLexer.h"
 #include "LTLParser.h"
 #include "LTLVisitor.h"
-#include "utils/bitset.h"
 #include "utils/error.h"
 #include "utils/irange.h"
 #include <ANTLRInputStream.h>
 #include <CommonTokenStream.h>
 #include <any>
+#include <cctype>
+#include <istream>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 namespace dark {
 
@@ -118,6 +124,15 @@ auto recursive_check(const BaseNode *node) -> void {
     }
 }
 
+auto readTS(std::istream &is, const LTLOptions &options, double &ts_parse_ms) -> TSGraph {
+    const auto timer = StatsTimer{ts_parse_ms};
+    auto graph       = TSGraph::read(is);
+    graph.reorder(options.order);
+    if (options.fairness != nullptr)
+        graph.read_fairness(*options.fairness);
+    return graph;
+}
+
 auto readLTL(std::istream &is, const TSGraph &graph) -> NodePtr {
     auto input  = antlr4::ANTLRInputStream(is);
     auto lexer  = LTLLexer(&input);
@@ -131,6 +146,46 @@ auto readLTL(std::istream &is, const TSGraph &graph) -> NodePtr {
     return root;
 }
 
+// reset the statistics before a query, and export them after it
+struct StatsRecorder {
+public:
+    StatsRecorder(const LTLOptions &options, double ts_parse_ms) :
+        options(options), ts_parse_ms(ts_parse_ms) {}
+
+    auto start(std::string initial) -> QueryStats & {
+        auto &stats       = query_stats();
+        stats             = QueryStats{};
+        stats.query       = count++;
+        stats.initial     = std::move(initial);
+        stats.ts_parse_ms = ts_parse_ms;
+        return stats;
+    }
+
+    auto finish(bool result) const -> bool {
+        auto &stats  = query_stats();
+        stats.result = result;
+        if (options.stats != nullptr)
+            write_stats(*options.stats, options.stats_format, stats);
+        return result;
+    }
+
+private:
+    const LTLOptions &options;
+    const double ts_parse_ms;
+    std::size_t count = 0;
+};
+
+// after the answer to a violated query, the lasso found for it on its own line
+// (see SearchOptions::counterexample)
+auto write_lasso(
+    std::ostream &os, const TSGraph &graph, const VerificationContext &context, bool result
+) -> void {
+    if (result || !context.lasso.has_value())
+        return;
+    graph.print(os, *context.lasso);
+    os << '\n';
+}
+
 } // namespace
 
 auto BaseNode::debug_print(std::ostream &os) const -> void {
@@ -160,7 +215,13 @@ auto BaseNode::debug_print(std::ostream &os) const -> void {
         binary->rhs->debug_print(os);
         os << ")";
     } else if (auto atomic = is<AtomicNode>()) {
-        os << atomic->index;
+        using enum AtomicNode::Type;
+        if (atomic->type == True)
+            os << "true";
+        else if (atomic->type == False)
+            os << "false";
+        else
+            os << atomic->index;
     }
 }
 
@@ -170,40 +231,98 @@ auto TSGraph::map_atomic(std::string_view action) const -> std::size_t {
     return it->second;
 }
 
-auto LTLProgram::work(std::istream &ts, std::istream &ltl, std::ostream &os) -> void {
+auto LTLProgram::work(
+    std::istream &ts, std::istream &ltl, std::ostream &os, const LTLOptions &options
+) -> void {
     static constexpr auto readline = [](std::istream &is) {
         auto line = std::string{};
         docheck(std::getline(is, line), "expect more lines");
         return std::stringstream{std::move(line)};
     };
 
-    const auto graph = TSGraph::read(ts);
+    auto ts_parse_ms = double{};
+    const auto graph = readTS(ts, options, ts_parse_ms);
+    auto recorder    = StatsRecorder{options, ts_parse_ms};
+    auto context     = VerificationContext{};
 
     auto num_test_all = std::size_t{};
     auto num_test_one = std::size_t{};
     readline(ltl) >> num_test_all >> num_test_one;
 
-    const auto view = TSView{graph};
+    const auto graph_view = TSView{graph};
     for ([[maybe_unused]] const auto _ : irange(num_test_all)) {
         auto ss      = readline(ltl);
-        auto formula = readLTL(ss, graph);
-        os << static_cast<int>(verifyLTL(formula.get(), view)) << '\n';
+        auto &stats  = recorder.start("all");
+        auto formula = [&] {
+            const auto timer = StatsTimer{stats.parse_ms};
+            return readLTL(ss, graph);
+        }();
+        const auto result = verifyLTL(formula.get(), graph_view, options.search, context);
+        os << static_cast<int>(recorder.finish(result)) << '\n';
+        write_lasso(os, graph, context, result);
     }
 
-    auto set = bitset{view.num_states};
-
     for ([[maybe_unused]] const auto _ : irange(num_test_one)) {
         auto ss         = readline(ltl);
         const auto view = [&] {
             auto num = std::size_t{};
             ss >> num;
-            set[num]  = true;
-            auto view = TSView{graph, set};
-            set[num]  = false;
-            return view;
+            docheck(num < graph_view.num_states, "initial state {} out of range", num);
+            return TSView{graph, std::vector{graph.to_internal(num)}};
+        }();
+        auto &stats  = recorder.start(std::to_string(graph.to_input(view.initial_set[0])));
+        auto formula = [&] {
+            const auto timer = StatsTimer{stats.parse_ms};
+            return readLTL(ss, graph);
         }();
-        auto formula = readLTL(ss, graph);
-        os << static_cast<int>(verifyLTL(formula.get(), view)) << '\n';
+        const auto result = verifyLTL(formula.get(), view, options.search, context);
+        os << static_cast<int>(recorder.finish(result)) << '\n';
+        write_lasso(os, graph, context, result);
+    }
+}
+
+auto LTLProgram::serve(
+    std::istream &ts, std::istream &is, std::ostream &os, const LTLOptions &options
+) -> void {
+    auto ts_parse_ms = double{};
+    const auto graph = readTS(ts, options, ts_parse_ms);
+    const auto view  = TSView{graph};
+    auto recorder    = StatsRecorder{options, ts_parse_ms};
+    auto context     = VerificationContext{}; // caches the automata across queries
+    auto line        = std::string{};
+
+    const auto query = [&](std::stringstream &ss) -> bool {
+        ss >> std::ws;
+        auto single = std::optional<std::size_t>{};
+        if (std::isdigit(ss.peek())) {
+            ss >> single.emplace();
+            docheck(*single < view.num_states, "initial state {} out of range", *single);
+        }
+
+        auto &stats        = recorder.start(single ? std::to_string(*single) : "all");
+        const auto formula = [&] {
+            const auto timer = StatsTimer{stats.parse_ms};
+            return readLTL(ss, graph);
+        }();
+        if (!single.has_value())
+            return recorder.finish(verifyLTL(formula.get(), view, options.search, context));
+        const auto scope = TSView{graph, std::vector{graph.to_internal(*single)}};
+        return recorder.finish(verifyLTL(formula.get(), scope, options.search, context));
+    };
+
+    // one query per line: "<formula>" or "<state> <formula>", answered by one line
+    while (std::getline(is, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        auto ss = std::stringstream{std::move(line)};
+        try {
+            const auto result = query(ss);
+            os << static_cast<int>(result) << '\n';
+            write_lasso(os, graph, context, result);
+            os.flush();
+        } catch (const LTLException &e) {
+            os << "error: " << e.what() << std::endl;
+        }
     }
 }
 
@@ -1,6 +1,7 @@
 #include "LTL/error.h"
 #include "LTL/input.h"
 #include "utils/error.h"
+#include "utils/thread_pool.h"
 #include <argparse/argparse.hpp>
 #include <format>
 #include <fstream>
@@ -32,6 +33,45 @@ auto work(int argc, const char **argv) -> void {
         .help("Enable verbose output")
         .default_value(false)
         .implicit_value(true);
+    program.add_argument("--stats").help("Export per-query statistics: json or csv").nargs(1);
+    program.add_argument("--stats-output").help("Statistics file path (default: stderr)").nargs(1);
+    program.add_argument("--external")
+        .help("Search the product system out of memory, spilling to this directory")
+        .nargs(1);
+    program.add_argument("--memory")
+        .help("Memory budget of the external search in MiB (default: 256)")
+        .nargs(1);
+    program.add_argument("--bit-parallel")
+        .help("Search with NBA state masks per TS state, if the NBA has at most 64 states")
+        .default_value(false)
+        .implicit_value(true);
+    program.add_argument("--swarm")
+        .help("Search with this many nested DFS workers in random orders (0: one per thread)")
+        .nargs(1);
+    program.add_argument("--parallel")
+        .help("Search the whole product with OWCTY, level by level on all the threads")
+        .default_value(false)
+        .implicit_value(true);
+    program.add_argument("--distributed")
+        .help("Search with this many worker processes, each owning a part of the product")
+        .nargs(1);
+    program.add_argument("--fairness")
+        .help("Fairness assumptions file: only the fair paths of the TS are checked")
+        .nargs(1);
+    program.add_argument("--counterexample")
+        .help("Print a violating lasso of the TS on the line after each 0")
+        .default_value(false)
+        .implicit_value(true);
+    program.add_argument("--reorder")
+        .help("Renumber the TS states for memory locality: input, bfs, dfs or rcm")
+        .nargs(1);
+    program.add_argument("--threads")
+        .help("Threads of the automaton translation (default: one per core)")
+        .nargs(1);
+    program.add_argument("--serve")
+        .help("Keep the TS resident and answer formula queries line by line from stdin")
+        .default_value(false)
+        .implicit_value(true);
 
     program.parse_args(argc, argv);
 
@@ -52,19 +92,105 @@ auto work(int argc, const char **argv) -> void {
         }
     }();
 
+    auto options    = dark::LTLOptions{};
+    auto stats_file = std::ofstream{};
+    if (auto format = program.present("--stats")) {
+        if (!dark::IN_STATS)
+            throw std::runtime_error(
+                "--stats requires a build with statistics (xmake f --stats=y)"
+            );
+        if (*format == "json")
+            options.stats_format = dark::StatsFormat::JSON;
+        else if (*format == "csv")
+            options.stats_format = dark::StatsFormat::CSV;
+        else
+            throw std::runtime_error("Unknown statistics format: " + *format);
+        options.stats = &std::cerr;
+        if (program.present("--stats-output")) {
+            stats_file.open(program.get("--stats-output"));
+            options.stats = &stats_file;
+        }
+    }
+
+    if (auto dir = program.present("--external")) {
+        options.search.engine       = dark::SearchOptions::Engine::External;
+        options.search.external_dir = *dir;
+    }
+    if (program["--bit-parallel"] == true) {
+        if (program.present("--external"))
+            throw std::runtime_error("Cannot use both --bit-parallel and --external");
+        options.search.engine = dark::SearchOptions::Engine::BitParallel;
+    }
+    if (auto workers = program.present("--swarm")) {
+        if (program.present("--external") || program["--bit-parallel"] == true)
+            throw std::runtime_error("Cannot use --swarm with another search engine");
+        options.search.engine        = dark::SearchOptions::Engine::Swarm;
+        options.search.swarm_workers = std::stoull(*workers);
+    }
+    if (program["--parallel"] == true) {
+        if (options.search.engine != dark::SearchOptions::Engine::NestedDFS)
+            throw std::runtime_error("Cannot use --parallel with another search engine");
+        options.search.engine = dark::SearchOptions::Engine::Parallel;
+    }
+    if (auto workers = program.present("--distributed")) {
+        if (options.search.engine != dark::SearchOptions::Engine::NestedDFS)
+            throw std::runtime_error("Cannot use --distributed with another search engine");
+        options.search.engine              = dark::SearchOptions::Engine::Distributed;
+        options.search.distributed_workers = std::stoull(*workers);
+    }
+    auto fairness_file = std::ifstream{};
+    if (auto path = program.present("--fairness")) {
+        if (options.search.engine != dark::SearchOptions::Engine::NestedDFS)
+            throw std::runtime_error("Cannot use --fairness with another search engine");
+        fairness_file.open(*path);
+        options.fairness = &fairness_file;
+    }
+    if (program["--counterexample"] == true) {
+        // the lasso is read off the stacks of the nested DFS, which sees no fairness
+        if (options.search.engine != dark::SearchOptions::Engine::NestedDFS
+            || options.fairness != nullptr)
+            throw std::runtime_error("Cannot use --counterexample with another engine or fairness");
+        options.search.counterexample = true;
+    }
+    if (auto memory = program.present("--memory")) {
+        if (!program.present("--external"))
+            throw std::runtime_error("--memory requires --external");
+        // each buffered state costs about 16 bytes (key and hash set entry). A fraction
+        // of a MiB makes even a small product spill, e.g. in the tests.
+        const auto bytes             = std::stod(*memory) * (1 << 20);
+        options.search.memory_states = static_cast<std::size_t>(bytes / 16);
+    }
+
+    if (auto name = program.present("--reorder")) {
+        if (auto order = dark::parse_state_order(*name))
+            options.order = *order;
+        else
+            throw std::runtime_error("Unknown state order: " + *name);
+    }
+
+    if (auto threads = program.present("--threads"))
+        dark::ThreadPool::configure(std::stoull(*threads));
+
+    if (program["--serve"] == true) {
+        if (program.present("--ltl"))
+            throw std::runtime_error("Cannot provide --ltl in server mode");
+        auto ts_stream = std::ifstream{program.get("--ts")};
+        return dark::LTLProgram::serve(ts_stream, std::cin, out_stream, options);
+    }
+
     if (auto vec = program.present<std::vector<std::string>>("file"); vec && vec->size() > 0) {
         if (program.present("--ts") || program.present("--ltl"))
             throw std::runtime_error("Cannot provide both positional and --ts/--ltl arguments");
         if (vec->size() != 1)
             throw std::runtime_error("Only one positional argument is allowed");
         auto in_file = std::ifstream{vec->at(0)};
-        return dark::LTLProgram::work(in_file, in_file, out_stream);
+        return dark::LTLProgram::work(in_file, in_file, out_stream, options);
     }
 
     auto ts_stream  = std::ifstream{program.get("--ts")};
     auto ltl_stream = std::ifstream{program.get("--ltl")};
 
-    return dark::LTLProgram::work(ts_stream, ltl_stream, out_stream);
+    return dark::LTLProgram::work(ts_stream, ltl_stream, out_stream, options);
 }
 
 auto main(int argc, const char **argv) -> int {
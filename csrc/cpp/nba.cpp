@@ -2,11 +2,269 @@
 #include "utils/bitset.h"
 #include "utils/error.h"
 #include "utils/irange.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+#include <span>
+#include <type_traits>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace dark {
 
-auto Automa::validate() const -> void {
+namespace {
+
+struct SCCs {
+    std::vector<std::size_t> index;   // state -> SCC
+    std::vector<std::uint8_t> cyclic; // SCC -> whether it contains a cycle
+};
+
+// iterative Tarjan over the given adjacency lists
+auto find_sccs(std::span<const std::vector<std::size_t>> adj) -> SCCs {
+    static constexpr auto kNone = static_cast<std::size_t>(-1);
+
+    struct Frame {
+        std::size_t state;
+        std::size_t next; // index of the next successor to visit
+    };
+
+    const auto n  = adj.size();
+    auto result   = SCCs{std::vector<std::size_t>(n, kNone), {}};
+    auto index    = std::vector<std::size_t>(n, kNone);
+    auto low      = std::vector<std::size_t>(n);
+    auto on_stack = std::vector<bool>(n);
+    auto stack    = std::vector<std::size_t>{};
+    auto frames   = std::vector<Frame>{};
+    auto counter  = std::size_t{};
+
+    const auto enter = [&](std::size_t v) {
+        index[v] = low[v] = counter++;
+        on_stack[v]       = true;
+        stack.push_back(v);
+        frames.push_back({v, 0});
+    };
+
+    for (const auto root : irange(n)) {
+        if (index[root] != kNone)
+            continue;
+        enter(root);
+        while (!frames.empty()) {
+            const auto v = frames.back().state;
+            if (frames.back().next < adj[v].size()) {
+                const auto w = adj[v][frames.back().next++];
+                if (index[w] == kNone)
+                    enter(w);
+                else if (on_stack[w])
+                    low[v] = std::min(low[v], index[w]);
+                continue;
+            }
+            frames.pop_back();
+            if (!frames.empty()) {
+                const auto u = frames.back().state;
+                low[u]       = std::min(low[u], low[v]);
+            }
+            if (low[v] != index[v])
+                continue;
+            const auto id = result.cyclic.size();
+            auto size     = std::size_t{};
+            auto w        = kNone;
+            do {
+                w = stack.back();
+                stack.pop_back();
+                on_stack[w]     = false;
+                result.index[w] = id;
+                ++size;
+            } while (w != v);
+            result.cyclic.push_back(size > 1 || std::ranges::find(adj[v], v) != adj[v].end());
+        }
+    }
+    return result;
+}
+
+// the targets of each state, over all its triggers
+template <typename _Set>
+auto successors_of(const BasicAutoma<_Set> &automa) -> std::vector<std::vector<std::size_t>> {
+    auto successors = std::vector<std::vector<std::size_t>>(automa.num_states);
+    for (const auto i : irange(automa.num_states))
+        for (const auto &[trig, set] : automa.transitions[i])
+            for (const auto j : set)
+                successors[i].push_back(j);
+    return successors;
+}
+
+// the states reachable from the given ones, themselves included
+template <typename _Set>
+auto reach(std::span<const std::vector<std::size_t>> adj, _Set from) -> _Set {
+    auto pending = std::vector<std::size_t>{};
+    for (const auto i : from)
+        pending.push_back(i);
+    while (!pending.empty()) {
+        const auto i = pending.back();
+        pending.pop_back();
+        for (const auto j : adj[i])
+            if (!from[j]) {
+                from[j] = true;
+                pending.push_back(j);
+            }
+    }
+    return from;
+}
+
+// SCC -> whether it is cyclic and meets every final set, i.e. a run may settle in it
+template <typename _Set>
+auto accepting_of(const SCCs &sccs, std::span<const _Set> finals) -> std::vector<std::uint8_t> {
+    auto meets = std::vector<std::size_t>(sccs.cyclic.size()); // number of final sets met
+    for (const auto &final : finals) {
+        auto met = std::vector<std::uint8_t>(sccs.cyclic.size());
+        for (const auto i : final)
+            met[sccs.index[i]] = true;
+        for (const auto c : irange(met.size()))
+            meets[c] += met[c];
+    }
+    auto result = std::vector<std::uint8_t>(sccs.cyclic.size());
+    for (const auto c : irange(result.size()))
+        result[c] = sccs.cyclic[c] && meets[c] == finals.size();
+    return result;
+}
+
+// Keep only the states reachable from the initial ones which can also reach an accepting
+// SCC, renumbered in order. The others are in no accepting run, so dropping them, and the
+// edges into them, changes no language. If none is left, a single dead state remains.
+template <typename _Set>
+auto trim(BasicAutoma<_Set> &automa, std::span<_Set> finals) -> void {
+    const auto n          = automa.num_states;
+    const auto successors = successors_of(automa);
+    const auto sccs       = find_sccs(successors);
+    const auto accepting  = accepting_of(sccs, std::span<const _Set>{finals});
+
+    auto predecessors = std::vector<std::vector<std::size_t>>(n);
+    auto productive   = _Set{n};
+    for (const auto i : irange(n)) {
+        for (const auto j : successors[i])
+            predecessors[j].push_back(i);
+        if (accepting[sccs.index[i]])
+            productive[i] = true;
+    }
+    productive = reach(predecessors, std::move(productive));
+
+    auto index = std::vector<std::size_t>(n);
+    auto size  = std::size_t{};
+    for (const auto i : reach(successors, automa.initial_states))
+        if (productive[i])
+            index[i] = ++size; // 0 for a dropped state
+    if (size == n)
+        return;
+
+    const auto new_size = std::max<std::size_t>(size, 1);
+    const auto remap    = [&](const _Set &set) {
+        auto result = _Set{new_size};
+        for (const auto i : set)
+            if (index[i] != 0)
+                result[index[i] - 1] = true;
+        return result;
+    };
+    auto transitions = std::vector<typename BasicAutoma<_Set>::EdgeMap>(new_size);
+    for (const auto i : irange(n)) {
+        if (index[i] == 0)
+            continue;
+        for (const auto &[trig, set] : automa.transitions[i])
+            if (auto targets = remap(set); targets.any())
+                transitions[index[i] - 1].try_emplace(trig, std::move(targets));
+    }
+    for (auto &final : finals)
+        final = remap(final);
+    automa.initial_states = remap(automa.initial_states);
+    automa.transitions    = std::move(transitions);
+    automa.num_states     = new_size;
+}
+
+// Classify the NBA by its SCCs. A cyclic SCC has a rejecting cycle iff its non-final
+// states contain a cycle by themselves. Sink states are the greatest set of final states
+// q such that, whatever q reads, some successor in the set reads each possible next label.
+template <typename _Set>
+auto classify(BasicNBA<_Set> &nba) -> void {
+    const auto n    = nba.num_states;
+    auto successors = std::vector<std::vector<std::size_t>>(n);
+    auto rejecting  = std::vector<std::vector<std::size_t>>(n); // among non-final states
+    for (const auto i : irange(n)) {
+        for (const auto &[trig, set] : nba.transitions[i]) {
+            for (const auto j : set) {
+                successors[i].push_back(j);
+                if (!nba.final_states[i] && !nba.final_states[j])
+                    rejecting[i].push_back(j);
+            }
+        }
+    }
+    const auto sccs = find_sccs(successors);
+    const auto loop = find_sccs(rejecting);
+
+    // only the states reachable from the initial ones matter
+    const auto reachable = reach(successors, nba.initial_states);
+
+    // SCC -> whether it has a final state, and whether it has a rejecting cycle
+    auto has_final     = std::vector<std::uint8_t>(sccs.cyclic.size());
+    auto has_rejecting = std::vector<std::uint8_t>(sccs.cyclic.size());
+    for (const auto i : reachable) {
+        const auto c = sccs.index[i];
+        if (!sccs.cyclic[c])
+            continue;
+        has_final[c]     = has_final[c] || nba.final_states[i];
+        has_rejecting[c] = has_rejecting[c] || (!nba.final_states[i] && loop.cyclic[loop.index[i]]);
+    }
+
+    nba.accepting_sccs = _Set{n};
+    for (const auto i : reachable) {
+        const auto c = sccs.index[i];
+        if (sccs.cyclic[c] && !has_rejecting[c])
+            nba.accepting_sccs[i] = true;
+    }
+
+    // at most 2^used labels, which the successors of a sink state must all cover
+    const auto num_used   = nba.used_ap_mask.count();
+    const auto num_labels = num_used < 32 ? std::size_t{1} << num_used : n + 1;
+    nba.sink_states       = num_labels <= n ? nba.final_states : _Set{n};
+    for (auto changed = true; changed;) {
+        changed = false;
+        for (const auto i : nba.sink_states) {
+            const auto covers_all = [&](const _Set &targets) {
+                auto labels = std::unordered_set<std::uint64_t>{};
+                for (const auto j : targets)
+                    if (nba.sink_states[j])
+                        for (const auto &[trig, _] : nba.transitions[j])
+                            labels.insert(trig.to_word());
+                return labels.size() == num_labels;
+            };
+            if (!std::ranges::all_of(nba.transitions[i] | std::views::values, covers_all)) {
+                nba.sink_states[i] = false;
+                changed            = true;
+            }
+        }
+    }
+
+    auto empty    = true; // no final state on a cycle
+    auto terminal = true; // all final states on a cycle are sinks
+    auto weak     = true; // no SCC with both accepting and rejecting cycles
+    for (const auto i : reachable) {
+        if (nba.final_states[i] && sccs.cyclic[sccs.index[i]]) {
+            empty    = false;
+            terminal = terminal && nba.sink_states[i];
+        }
+    }
+    for (const auto c : irange(sccs.cyclic.size()))
+        weak = weak && !(has_final[c] && has_rejecting[c]);
+
+    nba.strength = empty      ? Strength::Empty
+                   : terminal ? Strength::Terminal
+                   : weak     ? Strength::Weak
+                              : Strength::Strong;
+}
+
+} // namespace
+
+template <typename _Set>
+auto BasicAutoma<_Set>::validate() const -> void {
     assume(num_states > 0, "empty automa");
     assume(num_triggers > 0, "empty trigger set (AP)");
     for (const auto &edges : transitions) {
@@ -18,53 +276,238 @@ auto Automa::validate() const -> void {
     assume(used_ap_mask.size() == num_triggers, "invalid unused AP mask size");
 }
 
-auto NBA::fromGNBA(const GNBA &src) -> NBA {
+template <typename _Set>
+auto BasicAutoma<_Set>::num_edges() const -> std::size_t {
+    auto count = std::size_t{};
+    for (const auto &edges : transitions)
+        for (const auto &[trig, set] : edges)
+            count += set.count();
+    return count;
+}
+
+// The language of a GNBA is empty iff no reachable cyclic SCC meets every final set.
+// The initial states of a formula and of its negation partition the elementary sets,
+// so the same GNBA tells whether either of them is satisfiable.
+template <typename _Set>
+auto BasicGNBA<_Set>::decide(bool negate) const -> Satisfiability {
+    const auto n          = this->num_states;
+    const auto successors = successors_of(*this);
+    const auto sccs       = find_sccs(successors);
+
+    const auto accepting  = accepting_of(sccs, std::span<const _Set>{final_states_list});
+
+    const auto nonempty = [&](const _Set &from) {
+        for (const auto i : reach(successors, from))
+            if (accepting[sccs.index[i]])
+                return true;
+        return false;
+    };
+    auto others = _Set{n};
+    for (const auto i : irange(n))
+        others[i] = !this->initial_states[i];
+
+    const auto self    = nonempty(this->initial_states);
+    const auto other   = nonempty(others);
+    const auto holds   = negate ? other : self; // the formula is satisfiable
+    const auto refuted = negate ? self : other; // its negation is satisfiable
+    assume(holds || refuted, "a formula and its negation are both unsatisfiable");
+    return !refuted ? Satisfiability::Valid
+           : !holds ? Satisfiability::Unsatisfiable
+                    : Satisfiability::Contingent;
+}
+
+template <typename _Set>
+auto BasicGNBA<_Set>::trim() -> void {
+    dark::trim<_Set>(*this, final_states_list);
+}
+
+// Degeneralize by SCCs. A run is accepted iff it settles in a cyclic SCC which meets every
+// final set, so the counter over the final sets restarts whenever the run enters another SCC,
+// and the other SCCs need a single copy. Within an SCC, a final set which covers it is always
+// met, and a superset of another final set is met whenever the subset is, so neither needs a
+// level. The counter jumps over every remaining set which the current state belongs to.
+template <typename _Set>
+auto BasicNBA<_Set>::fromGNBA(const BasicGNBA<_Set> &src) -> BasicNBA {
     src.validate();
-    const auto num_final = src.final_states_list.size();
-    auto dst             = NBA();
-    if (num_final <= 1) {
-        dst.num_states     = src.num_states;
-        dst.num_triggers   = src.num_triggers; // same AP set as trigger.
-        dst.used_ap_mask   = src.used_ap_mask;
-        dst.initial_states = src.initial_states;
-        dst.final_states   = bitset{src.num_states};
-        if (num_final == 1)
-            dst.final_states = src.final_states_list[0];
-        else
-            dst.final_states.set_all();
-        dst.transitions = src.transitions;
-        dst.validate();
-        return dst;
-    }
-
-    const auto old_size = src.num_states;
-    const auto new_size = old_size * num_final;
+    const auto n          = src.num_states;
+    const auto &finals    = src.final_states_list;
+    const auto successors = successors_of(src);
+    const auto sccs       = find_sccs(successors);
+    const auto num_sccs   = sccs.cyclic.size();
+
+    auto members  = std::vector<std::vector<std::size_t>>(num_sccs);
+    auto position = std::vector<std::size_t>(n); // state -> index in the members of its SCC
+    for (const auto i : irange(n)) {
+        position[i] = members[sccs.index[i]].size();
+        members[sccs.index[i]].push_back(i);
+    }
+
+    // SCC -> whether a run may settle in it, and the final sets its counter runs over
+    auto accepting = std::vector<std::uint8_t>(num_sccs);
+    auto levels    = std::vector<std::vector<std::size_t>>(num_sccs);
+    for (const auto c : irange(num_sccs)) {
+        if (!sccs.cyclic[c])
+            continue;
+        const auto &scc = members[c];
+        const auto met  = [&](std::size_t t) {
+            return std::ranges::count_if(scc, [&](std::size_t i) { return finals[t][i]; });
+        };
+        auto candidates = std::vector<std::size_t>{};
+        auto meets_all  = true;
+        for (const auto t : irange(finals.size())) {
+            const auto count = static_cast<std::size_t>(met(t));
+            meets_all        = meets_all && count != 0;
+            if (count != 0 && count != scc.size())
+                candidates.push_back(t);
+        }
+        if (!meets_all)
+            continue;
+        accepting[c] = true;
+        // a subset within the SCC implies its supersets, and the first of equal ones the rest
+        const auto implies = [&](std::size_t lhs, std::size_t rhs) {
+            return std::ranges::all_of(scc, [&](std::size_t i) {
+                return !finals[lhs][i] || finals[rhs][i];
+            });
+        };
+        for (const auto a : candidates) {
+            const auto implied = std::ranges::any_of(candidates, [&](std::size_t b) {
+                return b != a && implies(b, a) && (b < a || !implies(a, b));
+            });
+            if (!implied)
+                levels[c].push_back(a);
+        }
+    }
 
+    // level 0 keeps the GNBA state ids, each further level of an SCC is appended
+    auto base     = std::vector<std::size_t>(num_sccs);
+    auto new_size = n;
+    for (const auto c : irange(num_sccs)) {
+        base[c] = new_size;
+        if (levels[c].size() > 1)
+            new_size += (levels[c].size() - 1) * members[c].size();
+    }
+    const auto id = [&](std::size_t i, std::size_t level) {
+        const auto c = sccs.index[i];
+        return level == 0 ? i : base[c] + (level - 1) * members[c].size() + position[i];
+    };
+    // the first level from the given one whose final set misses the state
+    const auto jump = [&](std::size_t i, std::size_t level) {
+        const auto &sets = levels[sccs.index[i]];
+        while (level < sets.size() && finals[sets[level]][i])
+            ++level;
+        return level;
+    };
+
+    auto dst           = BasicNBA();
     dst.num_states     = new_size;
     dst.num_triggers   = src.num_triggers; // same AP set as trigger.
     dst.used_ap_mask   = src.used_ap_mask;
     dst.initial_states = src.initial_states.expand(new_size);
-    dst.final_states   = src.final_states_list[0].expand(new_size);
-
-    // make the transition function
-    auto transitions = std::vector<EdgeMap>(new_size);
-    for (const auto j : irange(num_final)) {
-        const auto &final = src.final_states_list[j];
-        for (const auto i : irange(old_size)) {
-            auto &new_edges   = transitions[j * old_size + i];
-            const auto offset = ((j + final[i]) % num_final) * old_size;
+    dst.final_states   = _Set{new_size};
+    dst.transitions.resize(new_size);
+    for (const auto i : irange(n)) {
+        const auto c     = sccs.index[i];
+        const auto count = levels[c].size();
+        for (const auto level : irange(std::max<std::size_t>(count, 1))) {
+            const auto reached = jump(i, level);
+            const auto done    = reached == count;
+            // after a full round, the state also counts for the sets of the next one
+            auto next = done ? jump(i, 0) : reached;
+            if (next == count)
+                next = 0;
+            if (done && accepting[c])
+                dst.final_states[id(i, level)] = true;
+
+            auto &edges = dst.transitions[id(i, level)];
             for (const auto &[trig, set] : src.transitions[i]) {
-                auto [it, success] = new_edges.try_emplace(trig);
-                assume(success, "duplicate transition");
-                it->second.set_at(new_size, offset, set);
+                // leaving the SCC restarts the counter at level 0
+                auto targets = set.expand(new_size);
+                if (next != 0) {
+                    for (const auto j : members[c]) {
+                        if (set[j]) {
+                            targets[j]           = false;
+                            targets[id(j, next)] = true;
+                        }
+                    }
+                }
+                const auto inserted = edges.try_emplace(trig, std::move(targets)).second;
+                assume(inserted, "duplicate transition");
             }
         }
     }
 
-    dst.transitions = std::move(transitions);
+    trim<_Set>(dst, {&dst.final_states, 1});
     dst.validate();
-
+    dst.table = TransitionTable<_Set>::build(dst);
+    classify(dst);
     return dst;
 }
 
+template <typename _Set>
+auto TransitionTable<_Set>::build(const BasicAutoma<_Set> &src) -> TransitionTable {
+    // at most 2^kDenseAPs slots per state, and kMaxSlots in total
+    static constexpr auto kDenseAPs = std::size_t{8};
+    static constexpr auto kMaxSlots = std::size_t{1} << 22;
+
+    auto table     = TransitionTable{};
+    table.mask     = src.used_ap_mask.to_word();
+    table.num_used = src.used_ap_mask.count();
+    table.dense    = table.num_used <= kDenseAPs && (src.num_states << table.num_used) <= kMaxSlots;
+
+    if (table.dense) {
+        table.slots.assign(src.num_states << table.num_used, kNone);
+        for (const auto i : irange(src.num_states)) {
+            for (const auto &[trig, set] : src.transitions[i]) {
+                const auto key = trig.to_word();
+                assume((key & ~table.mask) == 0, "trigger out of the used AP mask");
+                table.slots[(i << table.num_used) | pext(key, table.mask)] = table.targets.size();
+                table.targets.push_back(set);
+            }
+        }
+    } else {
+        table.offsets.reserve(src.num_states + 1);
+        table.offsets.push_back(0);
+        for (const auto i : irange(src.num_states)) {
+            auto edges = std::vector<std::pair<std::uint64_t, const _Set *>>{};
+            for (const auto &[trig, set] : src.transitions[i])
+                edges.emplace_back(trig.to_word(), &set);
+            std::ranges::sort(edges, {}, [](const auto &edge) { return edge.first; });
+            for (const auto &[key, set] : edges) {
+                assume((key & ~table.mask) == 0, "trigger out of the used AP mask");
+                table.keys.push_back(key);
+                table.targets.push_back(*set);
+            }
+            table.offsets.push_back(table.keys.size());
+        }
+    }
+    return table;
+}
+
+auto NBA::fromGNBA(const GNBA &src) -> NBA {
+    auto result = src.visit([](const auto &gnba) {
+        using _Set = std::decay_t<decltype(gnba.initial_states)>;
+        return NBA{BasicNBA<_Set>::fromGNBA(gnba)};
+    });
+    result.satisfiability = src.satisfiability;
+    return result;
+}
+
+template struct BasicAutoma<basic_bitset<64>>;
+template struct BasicAutoma<basic_bitset<128>>;
+template struct BasicAutoma<basic_bitset<256>>;
+template struct BasicAutoma<basic_bitset<512>>;
+template struct BasicAutoma<dynamic_bitset>;
+
+template struct BasicGNBA<basic_bitset<64>>;
+template struct BasicGNBA<basic_bitset<128>>;
+template struct BasicGNBA<basic_bitset<256>>;
+template struct BasicGNBA<basic_bitset<512>>;
+template struct BasicGNBA<dynamic_bitset>;
+
+template struct TransitionTable<basic_bitset<64>>;
+template struct TransitionTable<basic_bitset<128>>;
+template struct TransitionTable<basic_bitset<256>>;
+template struct TransitionTable<basic_bitset<512>>;
+template struct TransitionTable<dynamic_bitset>;
+
 } // namespace dark
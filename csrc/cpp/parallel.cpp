@@ -0,0 +1,289 @@
+#include "LTL/automa.h"
+#include "LTL/error.h"
+#include "LTL/stats.h"
+#include "product.h"
+#include "utils/irange.h"
+#include "utils/thread_pool.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace dark {
+
+namespace {
+
+// product state (idx_ts, idx_nba), encoded as idx_ts * nba.num_states + idx_nba
+using Key = std::uint64_t;
+// product state, numbered once the BFS is done
+using Id = std::uint32_t;
+
+// a level smaller than this is expanded on the calling thread alone
+inline constexpr auto kMinParallel = std::size_t{256};
+
+// fn(i) for each i in [0, size), in chunks on the thread pool
+template <typename _Fn>
+auto parallel_for(std::size_t size, _Fn &&fn) -> void {
+    auto &pool            = ThreadPool::global();
+    const auto num_chunks = size < kMinParallel ? 1 : pool.size() * kChunksPerThread;
+    pool.run(num_chunks, [&](std::size_t c) {
+        for (const auto i : chunk_of(c, num_chunks, size))
+            fn(i);
+    });
+}
+
+// fn(item, out) for each item, in chunks on the thread pool, and the outputs concatenated
+template <typename _Tp, typename _Fn>
+auto expand(std::span<const _Tp> items, _Fn &&fn) -> std::vector<_Tp> {
+    auto &pool            = ThreadPool::global();
+    const auto num_chunks = items.size() < kMinParallel ? 1 : pool.size() * kChunksPerThread;
+    auto outputs          = std::vector<std::vector<_Tp>>(num_chunks);
+    pool.run(num_chunks, [&](std::size_t c) {
+        for (const auto i : chunk_of(c, num_chunks, items.size()))
+            fn(items[i], outputs[c]);
+    });
+    if (num_chunks == 1)
+        return std::move(outputs[0]);
+    auto result = std::vector<_Tp>{};
+    for (const auto &output : outputs)
+        result.insert(result.end(), output.begin(), output.end());
+    return result;
+}
+
+// The visited states of the BFS. While the key space is small enough, one atomic slot per
+// key, so an insertion is one exchange; otherwise, shards of a hash map, each behind its
+// own lock. Once the BFS is done, each slot holds the number of its state.
+struct VisitedTable {
+public:
+    explicit VisitedTable(Key num_keys) : dense(num_keys <= kMaxDense ? num_keys : 0) {}
+
+    // whether the state is new
+    auto insert(Key key) -> bool {
+        if (!dense.empty())
+            return dense[key].exchange(kFound, std::memory_order_relaxed) == kNone;
+        auto &shard     = shards[shard_of(key)];
+        const auto lock = std::scoped_lock{shard.mutex};
+        return shard.index.try_emplace(key, kFound).second;
+    }
+
+    // number the states by their position, after which the table is only read
+    auto freeze(std::span<const Key> states) -> void {
+        docheck(states.size() < std::numeric_limits<Id>::max(), "product too large for --parallel");
+        parallel_for(states.size(), [&](std::size_t id) {
+            if (!dense.empty())
+                dense[states[id]].store(static_cast<Id>(id), std::memory_order_relaxed);
+            else // the structure of the map no longer changes
+                shards[shard_of(states[id])].index.find(states[id])->second = static_cast<Id>(id);
+        });
+    }
+
+    auto id(Key key) const -> Id {
+        if (!dense.empty())
+            return dense[key].load(std::memory_order_relaxed);
+        return shards[shard_of(key)].index.at(key);
+    }
+
+private:
+    inline static constexpr auto kMaxDense = std::size_t{1} << 26; // 256 MiB of slots
+    inline static constexpr auto kShards   = std::size_t{64};
+    inline static constexpr auto kNone     = Id{0};
+    inline static constexpr auto kFound    = Id{1};
+
+    static auto shard_of(Key key) -> std::size_t {
+        return (key * 0x9E3779B97F4A7C15ull) >> 58; // the top 6 bits
+    }
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, Id> index; // state -> number
+    };
+
+    std::vector<std::atomic<Id>> dense;
+    std::array<Shard, kShards> shards;
+};
+
+// An exhaustive check on all the threads. The product is generated by a level-synchronous
+// BFS, each level expanded in chunks, and stored as compressed rows of successors. Then
+// One-Way-Catch-Them-Young runs on it with parallel levels too: alternately keep the states
+// reachable from accepting states, and drop those without predecessors, by counting the
+// predecessors of each state and propagating the drops. An accepting cycle exists iff the
+// fixpoint is not empty.
+template <typename _Set>
+struct ParallelProduct {
+public:
+    using NBA = BasicNBA<_Set>;
+
+    ParallelProduct(const LabelClasses &ts, const NBA &nba) :
+        ts(ts), nba(nba), visited(static_cast<Key>(ts.num_states) * nba.num_states) {}
+
+    auto can_run() -> bool {
+        explore();
+        auto set  = std::vector<std::uint8_t>(num_states, 1);
+        auto size = std::size_t{num_states};
+        call_in_stats_mode([&] { query_stats().outer_visited += size; });
+        while (size != 0) {
+            const auto last = size;
+            reach(set);
+            size = eliminate(set);
+            call_in_stats_mode([&] { query_stats().inner_visited += size; });
+            if (size == last)
+                break;
+        }
+        return size != 0;
+    }
+
+private:
+    auto encode(std::size_t idx_ts, std::size_t idx_nba) const -> Key {
+        return static_cast<Key>(idx_ts) * nba.num_states + idx_nba;
+    }
+
+    template <typename _Fn>
+    auto for_each_post(std::span<const LabelClasses::Group> groups, std::size_t idx_nba, _Fn &&fn)
+        const -> void {
+        for (const auto &group : groups)
+            if (auto *target = accept(nba, idx_nba, ts.label(group)))
+                for (const auto t : ts.states(group))
+                    for (const auto q : *target)
+                        fn(encode(t, q));
+    }
+
+    template <typename _Fn>
+    auto for_each_post(Key key, _Fn &&fn) const -> void {
+        const auto idx_ts  = static_cast<std::size_t>(key / nba.num_states);
+        const auto idx_nba = static_cast<std::size_t>(key % nba.num_states);
+        for_each_post(ts.post(idx_ts), idx_nba, fn);
+    }
+
+    // accepting states, except those whose TS state is on no cycle
+    auto is_accepting(Id id) const -> bool {
+        const auto key = states[id];
+        return nba.final_states[key % nba.num_states] && ts.on_cycle(key / nba.num_states);
+    }
+
+    auto successors(Id id) const -> std::span<const Id> {
+        return {targets.begin() + offsets[id], targets.begin() + offsets[id + 1]};
+    }
+
+    // the reachable product states, numbered level by level, and their successors
+    auto explore() -> void {
+        auto frontier = std::vector<Key>{};
+        for (const auto i : nba.initial_states)
+            for_each_post(ts.initial(), i, [&](Key key) {
+                if (visited.insert(key))
+                    frontier.push_back(key);
+            });
+        while (!frontier.empty()) {
+            states.insert(states.end(), frontier.begin(), frontier.end());
+            frontier = expand<Key>(frontier, [this](Key key, std::vector<Key> &out) {
+                for_each_post(key, [&](Key next) {
+                    if (visited.insert(next))
+                        out.push_back(next);
+                });
+            });
+        }
+        visited.freeze(states);
+        num_states = states.size();
+
+        // the rows of a chunk are contiguous, so the chunks are concatenated in order
+        auto &pool            = ThreadPool::global();
+        const auto num_chunks = num_states < kMinParallel ? 1 : pool.size() * kChunksPerThread;
+        auto rows             = std::vector<std::vector<Id>>(num_chunks);
+        auto degrees          = std::vector<Id>(num_states);
+        pool.run(num_chunks, [&](std::size_t c) {
+            for (const auto id : chunk_of(c, num_chunks, num_states)) {
+                const auto first = rows[c].size();
+                for_each_post(states[id], [&](Key next) {
+                    rows[c].push_back(visited.id(next));
+                });
+                degrees[id] = static_cast<Id>(rows[c].size() - first);
+            }
+        });
+        offsets.resize(num_states + 1);
+        for (const auto id : irange(num_states))
+            offsets[id + 1] = offsets[id] + degrees[id];
+        targets.reserve(offsets.back());
+        for (const auto &row : rows)
+            targets.insert(targets.end(), row.begin(), row.end());
+    }
+
+    auto states_of(const std::vector<std::uint8_t> &set, bool accepting) const -> std::vector<Id> {
+        auto result = std::vector<Id>{};
+        for (const auto id : irange<Id>(num_states))
+            if (set[id] && (!accepting || is_accepting(id)))
+                result.push_back(id);
+        return result;
+    }
+
+    // keep the states of the set reachable from its accepting states
+    auto reach(std::vector<std::uint8_t> &set) const -> void {
+        auto reached  = std::vector<std::atomic<std::uint8_t>>(num_states);
+        auto frontier = states_of(set, /*accepting=*/true);
+        for (const auto id : frontier)
+            reached[id].store(1, std::memory_order_relaxed);
+        while (!frontier.empty()) {
+            frontier = expand<Id>(frontier, [&](Id id, std::vector<Id> &out) {
+                for (const auto next : successors(id))
+                    if (set[next] && reached[next].exchange(1, std::memory_order_relaxed) == 0)
+                        out.push_back(next);
+            });
+        }
+        for (const auto id : irange(num_states))
+            set[id] = reached[id].load(std::memory_order_relaxed);
+    }
+
+    // drop the states of the set without predecessors in it, until there are none.
+    // return the size of the set
+    auto eliminate(std::vector<std::uint8_t> &set) const -> std::size_t {
+        auto count   = std::vector<std::atomic<Id>>(num_states);
+        auto members = states_of(set, /*accepting=*/false);
+        expand<Id>(members, [&](Id id, std::vector<Id> &) {
+            for (const auto next : successors(id))
+                if (set[next])
+                    count[next].fetch_add(1, std::memory_order_relaxed);
+        });
+        auto frontier = std::vector<Id>{};
+        for (const auto id : members)
+            if (count[id].load(std::memory_order_relaxed) == 0)
+                frontier.push_back(id);
+        auto dropped = frontier.size();
+        // a state is dropped by the thread that takes its count to zero
+        while (!frontier.empty()) {
+            frontier = expand<Id>(frontier, [&](Id id, std::vector<Id> &out) {
+                for (const auto next : successors(id))
+                    if (set[next] && count[next].fetch_sub(1, std::memory_order_relaxed) == 1)
+                        out.push_back(next);
+            });
+            dropped += frontier.size();
+        }
+        for (const auto id : members)
+            if (count[id].load(std::memory_order_relaxed) == 0)
+                set[id] = 0;
+        return members.size() - dropped;
+    }
+
+    const LabelClasses &ts;
+    const NBA &nba;
+
+    VisitedTable visited;
+    std::size_t num_states = 0;
+    std::vector<Key> states;          // number -> state
+    std::vector<std::size_t> offsets; // number -> range of targets
+    std::vector<Id> targets;          // successors of the states, by rows
+};
+
+} // namespace
+
+auto parallel_can_run(const LabelClasses &ts, const NBA &nba) -> bool {
+    return nba.visit([&]<typename _Set>(const BasicNBA<_Set> &nba) {
+        auto product = ParallelProduct<_Set>{ts, nba};
+        return product.can_run();
+    });
+}
+
+} // namespace dark
@@ -0,0 +1,71 @@
+#include "LTL/ts.h"
+#include "product.h"
+#include "utils/bitset.h"
+#include "utils/irange.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+namespace dark {
+
+LabelClasses::LabelClasses(const TSView &ts, const bitset &used_ap_mask) {
+    assign(ts, used_ap_mask);
+}
+
+auto LabelClasses::assign(const TSView &ts, const bitset &used_ap_mask) -> void {
+    num_states = ts.num_states;
+    labels.clear();
+    members.clear();
+    groups.clear();
+    offsets.clear();
+
+    classes.resize(ts.num_states);
+    auto class_map = std::unordered_map<std::uint64_t, std::size_t>{}; // label -> label class
+    for (const auto i : irange(ts.num_states)) {
+        const auto label    = ts.atomics[i] & used_ap_mask;
+        const auto [it, ok] = class_map.try_emplace(label.to_word(), labels.size());
+        if (ok)
+            labels.push_back({label, pext(label.to_word(), used_ap_mask.to_word())});
+        classes[i] = it->second;
+    }
+
+    offsets.reserve(ts.num_states + 2);
+    offsets.push_back(0);
+    for (const auto i : irange(ts.num_states))
+        push_row(ts.transitions[i]);
+    state_groups  = groups.size();
+    state_members = members.size();
+    assign_initial(ts);
+}
+
+// the last row is the initial set, as the successors of a virtual entry state
+auto LabelClasses::assign_initial(const TSView &ts) -> void {
+    scc      = ts.scc;
+    cyclic   = ts.cyclic;
+    live     = ts.live;
+    fairness = ts.fairness;
+    groups.resize(state_groups);
+    members.resize(state_members);
+    offsets.resize(num_states + 1);
+    push_row(ts.initial_set);
+}
+
+// the groups of a row of successors, by label class
+auto LabelClasses::push_row(std::span<const std::size_t> row) -> void {
+    buffer.clear();
+    for (const auto t : row)
+        buffer.emplace_back(classes[t], t);
+    std::ranges::sort(buffer);
+    for (const auto &[label, t] : buffer) {
+        if (groups.size() == offsets.back() || groups.back().label != label)
+            groups.push_back({label, members.size(), members.size()});
+        members.push_back(t);
+        groups.back().last = members.size();
+    }
+    offsets.push_back(groups.size());
+}
+
+} // namespace dark
@@ -0,0 +1,130 @@
+// internal helpers shared by the product system engines
+#pragma once
+#include "LTL/automa.h"
+#include "LTL/context.h"
+#include "LTL/search.h"
+#include "LTL/stats.h"
+#include "LTL/ts.h"
+#include "utils/bitset.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dark {
+
+// The TS as seen by one formula. States are partitioned into label classes by their
+// label under the used AP mask, and the successors of each state are grouped by class,
+// so that the NBA is probed once per (NBA state, label class) instead of per successor.
+struct LabelClasses {
+public:
+    struct Group {
+        std::size_t label; // label class
+        std::size_t first; // successors of this class: [first, last) of members
+        std::size_t last;
+    };
+    struct Label {
+        bitset bits;              // under the mask
+        std::uint64_t compressed; // the same, compressed to the used APs (see pext)
+    };
+
+    LabelClasses() = default;
+    LabelClasses(const TSView &, const bitset &used_ap_mask);
+
+    // rebuild for another TS view or mask, in the storage of the previous one
+    auto assign(const TSView &, const bitset &used_ap_mask) -> void;
+    // rebuild the row of the initial set only, for another view of the same TS and mask
+    auto assign_initial(const TSView &) -> void;
+
+    // the groups of the successors of a TS state, or of the initial states
+    auto post(std::size_t idx_ts) const -> std::span<const Group> {
+        return {groups.begin() + offsets[idx_ts], groups.begin() + offsets[idx_ts + 1]};
+    }
+    auto initial() const -> std::span<const Group> {
+        return post(num_states);
+    }
+
+    auto label(const Group &g) const -> const Label & {
+        return labels[g.label];
+    }
+    auto label(std::size_t idx) const -> const Label & {
+        return labels[idx];
+    }
+    auto num_labels() const -> std::size_t {
+        return labels.size();
+    }
+    auto states(const Group &g) const -> std::span<const std::size_t> {
+        return {members.begin() + g.first, members.begin() + g.last};
+    }
+
+    // whether a TS state is in a cyclic SCC, i.e. it may be on a product cycle
+    auto on_cycle(std::size_t idx_ts) const -> bool {
+        return cyclic[scc[idx_ts]];
+    }
+    // whether an infinite path, a fair one if any fairness, starts at a TS state
+    auto is_live(std::size_t idx_ts) const -> bool {
+        return live[scc[idx_ts]];
+    }
+
+    std::size_t num_states = 0;           // number of TS states
+    std::span<const std::size_t> scc;     // TS state -> SCC
+    std::span<const std::uint8_t> cyclic; // SCC -> whether it contains a cycle
+    std::span<const std::uint8_t> live;   // SCC -> whether it starts an infinite (fair) path
+    std::span<const Fairness> fairness;   // only fair paths count, if any
+
+private:
+    auto push_row(std::span<const std::size_t>) -> void;
+
+    std::vector<Label> labels;        // label class -> label
+    std::vector<std::size_t> members; // successors, grouped by label class
+    std::vector<Group> groups;        // groups of each state, then of the initial set
+    std::vector<std::size_t> offsets; // TS state -> range of groups
+
+    std::vector<std::size_t> classes;                        // TS state -> label class
+    std::vector<std::pair<std::size_t, std::size_t>> buffer; // (label class, state) of a row
+    std::size_t state_groups  = 0;                           // groups before the initial row
+    std::size_t state_members = 0;                           // members before the initial row
+};
+
+// The label classes of a TS view under a mask, cached in the context by mask: they are
+// built once per TS and mask, and only their initial row per view. Valid until the next
+// call with the same context.
+auto label_classes(VerificationContext &, const TSView &, const bitset &used_ap_mask)
+    -> const LabelClasses &;
+
+// Whether an NBA accept at a state idx with the label of a class as trigger
+template <typename _Set>
+inline auto accept(const BasicNBA<_Set> &nba, std::size_t idx, const LabelClasses::Label &label)
+    -> const _Set * {
+    call_in_stats_mode([] { ++query_stats().hash_probes; });
+    return nba.table.find(idx, label.bits, label.compressed);
+}
+
+// the answer for a valid or an unsatisfiable formula, which needs no product,
+// or nullopt if the formula is contingent. See verifier.cpp
+auto decided(Satisfiability, const TSView &) -> std::optional<bool>;
+
+// external memory engine, see external.cpp
+auto external_can_run(const LabelClasses &, const NBA &, const SearchOptions &) -> bool;
+
+// bit-parallel engine for NBAs of at most kMaxBitwiseStates states, of any width,
+// see bitwise.cpp
+inline constexpr auto kMaxBitwiseStates = std::size_t{64};
+auto bitwise_can_run(const LabelClasses &, const NBA &) -> bool;
+
+// randomized nested DFS workers on the thread pool, see swarm.cpp
+auto swarm_can_run(const LabelClasses &, const NBA &, const SearchOptions &) -> bool;
+
+// exhaustive OWCTY with parallel BFS levels on the thread pool, see parallel.cpp
+auto parallel_can_run(const LabelClasses &, const NBA &) -> bool;
+
+// OWCTY over worker processes connected by local sockets, see distributed.cpp
+auto distributed_can_run(const LabelClasses &, const NBA &, const SearchOptions &) -> bool;
+
+// fair SCCs of the whole product, under the fairness assumptions of the TS, see fairness.cpp
+auto fair_can_run(const LabelClasses &, const NBA &) -> bool;
+
+} // namespace dark
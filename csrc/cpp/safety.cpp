@@ -0,0 +1,221 @@
+#include "LTL/automa.h"
+#include "LTL/node.h"
+#include "LTL/node_impl.h"
+#include "LTL/search.h"
+#include "LTL/stats.h"
+#include "LTL/ts.h"
+#include "product.h"
+#include "utils/error.h"
+#include "utils/irange.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <variant>
+#include <vector>
+
+namespace dark {
+
+namespace {
+
+// Whether a formula is syntactically safe: in negation normal form, it uses neither
+// until nor eventually. Under an odd number of negations, F and U turn into G and
+// release, which are safe, while G turns into F.
+auto is_safety(const BaseNode *node, bool positive) -> bool {
+    if (node->is<AtomicNode>())
+        return true;
+    if (auto ptr = node->is<NotNode>())
+        return is_safety(ptr->child.get(), !positive);
+    if (auto ptr = node->is<NextNode>())
+        return is_safety(ptr->child.get(), positive);
+    if (auto ptr = node->is<AlwaysNode>())
+        return positive && is_safety(ptr->child.get(), positive);
+    if (auto ptr = node->is<EventualNode>())
+        return !positive && is_safety(ptr->child.get(), positive);
+    if (auto ptr = node->is<ImplNode>())
+        return is_safety(ptr->lhs.get(), !positive) && is_safety(ptr->rhs.get(), positive);
+    if (node->is<UntilNode>() && positive)
+        return false;
+    if (auto ptr = node->is<BinaryNode>())
+        return is_safety(ptr->lhs.get(), positive) && is_safety(ptr->rhs.get(), positive);
+    panic("Invalid node type");
+}
+
+// For a safety formula, every run of the GNBA that never blocks satisfies the formula,
+// whatever the acceptance sets. So a path violates the formula iff the set of GNBA
+// states reached on some prefix is empty, and that prefix extends to an infinite path.
+// The subset automaton is the DFA of the bad prefixes, built on the fly per label class.
+// A DFA state with a GNBA state which never blocks on the labels of the TS never reaches
+// the bad prefix, so the product states on it are not explored.
+template <typename _Set>
+struct SafetyProduct {
+public:
+    SafetyProduct(const LabelClasses &ts, const BasicGNBA<_Set> &gnba) :
+        ts(ts), num_states(gnba.num_states), table(gnba.table),
+        universal(unblocking(ts, gnba)) {
+        intern(_Set{num_states}); // the empty set, i.e. a bad prefix
+        initial = intern(gnba.initial_states);
+    }
+
+    // forward search, until the first bad prefix
+    auto holds() -> bool {
+        if (!co_bad[initial])
+            return true;
+        for (const auto &group : ts.initial())
+            if (!visit(group, step(initial, group.label)))
+                return false;
+        while (!pending.empty()) {
+            const auto [idx_ts, idx_dfa] = pending.back();
+            pending.pop_back();
+            for (const auto &group : ts.post(idx_ts))
+                if (!visit(group, step(idx_dfa, group.label)))
+                    return false;
+        }
+        return true;
+    }
+
+private:
+    inline static constexpr auto kBad     = std::uint32_t{0};
+    inline static constexpr auto kUnknown = ~std::uint32_t{};
+
+    struct State {
+        std::size_t idx_ts;
+        std::uint32_t idx_dfa;
+        [[maybe_unused]] // clangd false positive warning
+        friend auto
+        operator==(const State &lhs, const State &rhs) -> bool = default;
+    };
+
+    struct Hash {
+        auto operator()(const State &s) const -> std::size_t {
+            return std::rotl(s.idx_ts, 32) ^ s.idx_dfa;
+        }
+    };
+
+    // The greatest set of GNBA states from which every label class of the TS leads back
+    // into the set: from any of them, a run goes on over any sequence of TS labels.
+    static auto unblocking(const LabelClasses &ts, const BasicGNBA<_Set> &gnba) -> _Set {
+        auto result = _Set{gnba.num_states};
+        result.set_all();
+        for (auto changed = true; changed;) {
+            changed = false;
+            for (const auto q : _Set{result}) {
+                for (const auto label : irange(ts.num_labels())) {
+                    const auto &trigger = ts.label(label);
+                    const auto *target  = gnba.table.find(q, trigger.bits, trigger.compressed);
+                    if (target == nullptr || (*target & result).none()) {
+                        result[q] = false;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+        return result;
+    }
+
+    // the id of a set of GNBA states, as a DFA state
+    auto intern(const _Set &set) -> std::uint32_t {
+        const auto [it, inserted] = ids.try_emplace(set, static_cast<std::uint32_t>(sets.size()));
+        if (inserted) {
+            sets.push_back(set);
+            co_bad.push_back((set & universal).none());
+            delta.resize(delta.size() + ts.num_labels(), kUnknown);
+        }
+        return it->second;
+    }
+
+    // the DFA state after reading a label class
+    auto step(std::uint32_t idx_dfa, std::size_t label) -> std::uint32_t {
+        const auto pos = idx_dfa * ts.num_labels() + label;
+        if (delta[pos] != kUnknown)
+            return delta[pos];
+        const auto &trigger = ts.label(label);
+        auto next           = _Set{num_states};
+        for (const auto q : sets[idx_dfa]) {
+            call_in_stats_mode([] { ++query_stats().hash_probes; });
+            if (auto *target = table.find(q, trigger.bits, trigger.compressed))
+                next |= *target;
+        }
+        const auto result = intern(next);
+        delta[pos]        = result;
+        return result;
+    }
+
+    // enqueue the successors in a group, or return false on a bad prefix.
+    // States without an infinite path can never complete a counterexample.
+    auto visit(const LabelClasses::Group &group, std::uint32_t idx_dfa) -> bool {
+        if (!co_bad[idx_dfa])
+            return true;
+        for (const auto t : ts.states(group)) {
+            if (!ts.is_live(t))
+                continue;
+            if (idx_dfa == kBad)
+                return false;
+            const auto inserted = visited.insert({t, idx_dfa}).second;
+            if (inserted)
+                pending.push_back({t, idx_dfa});
+            call_in_stats_mode([&] {
+                auto &stats = query_stats();
+                stats.hash_probes += 1;
+                stats.outer_visited += inserted;
+                stats.peak_stack = std::max(stats.peak_stack, pending.size());
+            });
+        }
+        return true;
+    }
+
+    const LabelClasses &ts;
+    const std::size_t num_states;
+    const TransitionTable<_Set> &table;
+    const _Set universal; // GNBA states which never block, see unblocking
+
+    std::uint32_t initial;                       // DFA state of the initial GNBA states
+    std::vector<_Set> sets;                      // DFA state -> set of GNBA states
+    std::vector<std::uint8_t> co_bad;            // DFA state -> whether it may reach kBad
+    std::unordered_map<_Set, std::uint32_t> ids; // set of GNBA states -> DFA state
+    std::vector<std::uint32_t> delta;            // (DFA state, label class) -> DFA state
+    std::unordered_set<State, Hash> visited;     // visited product states
+    std::vector<State> pending;                  // product states to expand
+};
+
+} // namespace
+
+auto safetyLTL(BaseNode *node, std::size_t num_atomics, const SearchOptions &options)
+    -> std::optional<GNBA> {
+    // the visited set of the reachability is in memory, and keeps no path for a lasso
+    if (options.engine == SearchOptions::Engine::External || options.counterexample)
+        return std::nullopt;
+    if (!is_safety(node, /*positive=*/true))
+        return std::nullopt;
+    auto &stats      = query_stats();
+    const auto timer = StatsTimer{stats.translate_ms};
+    auto gnba        = GNBA::build(node, num_atomics, /*negate=*/false);
+    std::visit(
+        []<typename _Set>(BasicGNBA<_Set> &gnba) {
+            gnba.table = TransitionTable<_Set>::build(gnba);
+        },
+        gnba.impl
+    );
+    call_in_stats_mode([&] {
+        stats.gnba_states += gnba.num_states();
+        stats.gnba_edges  += gnba.num_edges();
+    });
+    return gnba;
+}
+
+auto verifySafety(const GNBA &gnba, const TSView &ts, VerificationContext &context) -> bool {
+    const auto timer = StatsTimer{query_stats().search_ms};
+    if (const auto result = decided(gnba.satisfiability, ts))
+        return *result;
+    const auto &labels = label_classes(context, ts, gnba.used_ap_mask());
+    return gnba.visit([&labels]<typename _Set>(const BasicGNBA<_Set> &gnba) {
+        auto product = SafetyProduct<_Set>{labels, gnba};
+        return product.holds();
+    });
+}
+
+} // namespace dark
@@ -0,0 +1,130 @@
+#include "LTL/node.h"
+#include "LTL/node_impl.h"
+#include "utils/error.h"
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace dark {
+
+namespace {
+
+auto clone(const BaseNode *node) -> NodePtr {
+    if (auto ptr = node->is<AtomicNode>())
+        return std::make_unique<AtomicNode>(ptr->index, ptr->type);
+    if (auto ptr = node->is<NotNode>())
+        return std::make_unique<NotNode>(clone(ptr->child.get()));
+    if (auto ptr = node->is<NextNode>())
+        return std::make_unique<NextNode>(clone(ptr->child.get()));
+    if (auto ptr = node->is<AlwaysNode>())
+        return std::make_unique<AlwaysNode>(clone(ptr->child.get()));
+    if (auto ptr = node->is<EventualNode>())
+        return std::make_unique<EventualNode>(clone(ptr->child.get()));
+    if (auto ptr = node->is<ConjNode>())
+        return std::make_unique<ConjNode>(clone(ptr->lhs.get()), clone(ptr->rhs.get()));
+    if (auto ptr = node->is<DisjNode>())
+        return std::make_unique<DisjNode>(clone(ptr->lhs.get()), clone(ptr->rhs.get()));
+    if (auto ptr = node->is<ImplNode>())
+        return std::make_unique<ImplNode>(clone(ptr->lhs.get()), clone(ptr->rhs.get()));
+    if (auto ptr = node->is<UntilNode>())
+        return std::make_unique<UntilNode>(clone(ptr->lhs.get()), clone(ptr->rhs.get()));
+    panic("Invalid node type");
+}
+
+// number of nodes, whose distinct subformulas bound the bits of an elementary set
+auto size_of(const BaseNode *node) -> std::size_t {
+    if (auto ptr = node->is<UnaryNode>())
+        return 1 + size_of(ptr->child.get());
+    if (auto ptr = node->is<BinaryNode>())
+        return 1 + size_of(ptr->lhs.get()) + size_of(ptr->rhs.get());
+    return 1;
+}
+
+// Collects the conjuncts of a formula. Both X and G distribute over a conjunction,
+// so they are kept as a prefix, from the outermost, and put back on each conjunct.
+struct Splitter {
+public:
+    enum class Op { Next, Always };
+
+    auto split(const BaseNode *node, bool negated) -> void {
+        if (auto ptr = node->is<NotNode>())
+            return split(ptr->child.get(), !negated);
+        if (auto ptr = node->is<ConjNode>(); ptr && !negated) {
+            split(ptr->lhs.get(), false);
+            return split(ptr->rhs.get(), false);
+        }
+        if (auto ptr = node->is<DisjNode>(); ptr && negated) { // !(a \/ b) = !a /\ !b
+            split(ptr->lhs.get(), true);
+            return split(ptr->rhs.get(), true);
+        }
+        if (auto ptr = node->is<ImplNode>(); ptr && negated) { // !(a -> b) = a /\ !b
+            split(ptr->lhs.get(), false);
+            return split(ptr->rhs.get(), true);
+        }
+        if (auto ptr = node->is<NextNode>()) // !X a = X !a
+            return nested(Op::Next, ptr->child.get(), negated);
+        if (auto ptr = node->is<AlwaysNode>(); ptr && !negated)
+            return nested(Op::Always, ptr->child.get(), false);
+        if (auto ptr = node->is<EventualNode>(); ptr && negated) // !F a = G !a
+            return nested(Op::Always, ptr->child.get(), true);
+        conjuncts.push_back(wrap(clone(node), negated));
+    }
+
+    std::vector<NodePtr> conjuncts;
+
+private:
+    auto nested(Op op, const BaseNode *child, bool negated) -> void {
+        // G G a = G a
+        const auto redundant = op == Op::Always && !prefix.empty() && prefix.back() == op;
+        if (!redundant)
+            prefix.push_back(op);
+        split(child, negated);
+        if (!redundant)
+            prefix.pop_back();
+    }
+
+    auto wrap(NodePtr node, bool negated) const -> NodePtr {
+        if (negated)
+            node = std::make_unique<NotNode>(std::move(node));
+        for (const auto op : prefix | std::views::reverse) {
+            if (op == Op::Next)
+                node = std::make_unique<NextNode>(std::move(node));
+            else
+                node = std::make_unique<AlwaysNode>(std::move(node));
+        }
+        return node;
+    }
+
+    std::vector<Op> prefix;
+};
+
+} // namespace
+
+auto splitLTL(const BaseNode *node) -> std::vector<NodePtr> {
+    auto splitter = Splitter{};
+    splitter.split(node, /*negated=*/false);
+    auto &conjuncts = splitter.conjuncts;
+    // keep the formula as it is, so that it is translated just as before
+    if (conjuncts.size() <= 1) {
+        conjuncts.clear();
+        conjuncts.push_back(clone(node));
+        return std::move(conjuncts);
+    }
+
+    // drop the duplicates, then sort by the estimated cost of translation
+    auto seen = std::unordered_set<std::string>{};
+    std::erase_if(conjuncts, [&seen](const NodePtr &conjunct) {
+        auto key = std::ostringstream{};
+        conjunct->debug_print(key);
+        return !seen.insert(std::move(key).str()).second;
+    });
+    std::ranges::stable_sort(conjuncts, {}, [](const NodePtr &c) { return size_of(c.get()); });
+    return std::move(conjuncts);
+}
+
+} // namespace dark
@@ -0,0 +1,41 @@
+#include "LTL/stats.h"
+#include <format>
+#include <ostream>
+
+namespace dark {
+
+auto query_stats() -> QueryStats & {
+    static thread_local auto stats = QueryStats{};
+    return stats;
+}
+
+auto write_stats(std::ostream &os, StatsFormat format, const QueryStats &s) -> void {
+    if (format == StatsFormat::CSV) {
+        if (s.query == 0)
+            os << "query,initial,result,set_candidates,set_accepted,gnba_states,gnba_edges,"
+                  "nba_states,nba_edges,outer_visited,inner_visited,hash_probes,peak_stack,"
+                  "ts_parse_ms,parse_ms,translate_ms,degeneralize_ms,search_ms\n";
+        os << std::format(
+            "{},{},{},{},{},{},{},{},{},{},{},{},{},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f}\n", s.query,
+            s.initial, static_cast<int>(s.result), s.set_candidates, s.set_accepted, s.gnba_states,
+            s.gnba_edges, s.nba_states, s.nba_edges, s.outer_visited, s.inner_visited,
+            s.hash_probes, s.peak_stack, s.ts_parse_ms, s.parse_ms, s.translate_ms,
+            s.degeneralize_ms, s.search_ms
+        );
+    } else {
+        os << std::format(
+            "{{\"query\": {}, \"initial\": \"{}\", \"result\": {}, \"set_candidates\": {}, "
+            "\"set_accepted\": {}, \"gnba_states\": {}, \"gnba_edges\": {}, \"nba_states\": {}, "
+            "\"nba_edges\": {}, \"outer_visited\": {}, \"inner_visited\": {}, "
+            "\"hash_probes\": {}, \"peak_stack\": {}, \"ts_parse_ms\": {:.3f}, "
+            "\"parse_ms\": {:.3f}, \"translate_ms\": {:.3f}, \"degeneralize_ms\": {:.3f}, "
+            "\"search_ms\": {:.3f}}}\n",
+            s.query, s.initial, s.result, s.set_candidates, s.set_accepted, s.gnba_states,
+            s.gnba_edges, s.nba_states, s.nba_edges, s.outer_visited, s.inner_visited,
+            s.hash_probes, s.peak_stack, s.ts_parse_ms, s.parse_ms, s.translate_ms,
+            s.degeneralize_ms, s.search_ms
+        );
+    }
+}
+
+} // namespace dark
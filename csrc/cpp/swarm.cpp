@@ -0,0 +1,211 @@
+#include "LTL/automa.h"
+#include "LTL/search.h"
+#include "LTL/stats.h"
+#include "product.h"
+#include "utils/error.h"
+#include "utils/thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+namespace dark {
+
+namespace {
+
+// what a swarm worker visited, see QueryStats
+struct SwarmCounts {
+    std::size_t outer_visited = 0;
+    std::size_t inner_visited = 0;
+    std::size_t peak_stack    = 0;
+};
+
+// One nested DFS of the swarm. Every worker but the first visits the successors of a
+// state in its own random order, so the workers run into different parts of a large
+// product first. Each search is complete, so the first one to finish settles the answer,
+// whether it found an accepting cycle or not, and the others are stopped.
+template <typename _Set>
+struct SwarmWorker {
+public:
+    SwarmWorker(
+        const LabelClasses &ts, const BasicNBA<_Set> &nba, std::size_t id,
+        const std::atomic<bool> &stop
+    ) : ts(ts), nba(nba), shuffle(id != 0), random(id), stop(stop) {}
+
+    // whether an accepting cycle is reachable, or nullopt if stopped before knowing
+    auto can_run() -> std::optional<bool> {
+        auto initial = std::vector<std::size_t>{};
+        for (const auto i : nba.initial_states)
+            initial.push_back(i);
+        if (shuffle)
+            std::ranges::shuffle(initial, random);
+        for (const auto i : initial)
+            if (const auto result = reachable_cycle({kEntry, i}); !result || *result)
+                return result;
+        return false;
+    }
+
+    auto counts() const -> const SwarmCounts & {
+        return stats;
+    }
+
+private:
+    inline static constexpr auto kEntry = static_cast<std::size_t>(-1);
+
+    struct State {
+        std::size_t idx_ts;
+        std::size_t idx_nba;
+        [[maybe_unused]] // clangd false positive warning
+        friend auto
+        operator==(const State &lhs, const State &rhs) -> bool = default;
+    };
+
+    struct Hash {
+        auto operator()(const State &s) const -> std::size_t {
+            return std::rotl(s.idx_ts, 32) ^ s.idx_nba;
+        }
+    };
+
+    // the successors of a frame are [next, first of the frame above), or up to the end
+    // of succ for the top frame, so only the top frame is ever advanced
+    struct Frame {
+        State state;
+        std::size_t first;
+        std::size_t next;
+    };
+
+    auto push(State s) -> void {
+        const auto first  = succ.size();
+        const auto groups = (s.idx_ts == kEntry) ? ts.initial() : ts.post(s.idx_ts);
+        for (const auto &group : groups)
+            if (auto *target = accept(nba, s.idx_nba, ts.label(group)))
+                for (const auto t : ts.states(group))
+                    for (const auto q : *target)
+                        succ.push_back({t, q});
+        if (shuffle)
+            std::shuffle(succ.begin() + first, succ.end(), random);
+        frames.push_back({s, first, first});
+        stats.peak_stack = std::max(stats.peak_stack, frames.size());
+    }
+
+    auto pop() -> void {
+        succ.resize(frames.back().first);
+        frames.pop_back();
+    }
+
+    // the next successor of the top frame, if any
+    auto advance() -> std::optional<State> {
+        auto &top = frames.back();
+        if (top.next == succ.size())
+            return std::nullopt;
+        return succ[top.next++];
+    }
+
+    auto stopped() const -> bool {
+        return stop.load(std::memory_order_relaxed);
+    }
+
+    auto reachable_cycle(State input) -> std::optional<bool> {
+        if (!R.insert(input).second)
+            return false;
+        push(input);
+        while (!frames.empty()) {
+            if (stopped())
+                return std::nullopt;
+            if (const auto s = advance()) {
+                const auto inserted  = R.insert(*s).second;
+                stats.outer_visited += inserted;
+                if (inserted)
+                    push(*s);
+            } else {
+                const auto cur = frames.back().state;
+                pop();
+                if (const auto result = cycle_check(cur); !result || *result)
+                    return result;
+            }
+        }
+        return false;
+    }
+
+    // the inner DFS runs on top of the outer frames, as in ProductSystem::cycle_check
+    auto cycle_check(State start) -> std::optional<bool> {
+        const auto [idx_ts, idx_nba] = start;
+        if (idx_ts == kEntry || !nba.final_states[idx_nba] || !ts.on_cycle(idx_ts))
+            return false;
+
+        const auto scc  = ts.scc[idx_ts];
+        const auto base = frames.size();
+        T.clear();
+        T.insert(start);
+        push(start);
+        while (frames.size() != base) {
+            if (stopped())
+                return std::nullopt;
+            if (const auto s = advance()) {
+                if (*s == start)
+                    return true;
+                const auto inserted  = ts.scc[s->idx_ts] == scc && T.insert(*s).second;
+                stats.inner_visited += inserted;
+                if (inserted)
+                    push(*s);
+            } else {
+                pop();
+            }
+        }
+        return false;
+    }
+
+    const LabelClasses &ts;
+    const BasicNBA<_Set> &nba;
+    const bool shuffle;
+    std::mt19937_64 random;
+    const std::atomic<bool> &stop;
+
+    std::unordered_set<State, Hash> R; // visited states in outer DFS
+    std::unordered_set<State, Hash> T; // visited states in the running inner DFS
+    std::vector<Frame> frames;         // outer frames, then inner frames
+    std::vector<State> succ;           // successors of the frames, in visiting order
+    SwarmCounts stats;
+};
+
+} // namespace
+
+auto swarm_can_run(const LabelClasses &ts, const NBA &nba, const SearchOptions &options) -> bool {
+    auto &pool             = ThreadPool::global();
+    const auto num_workers = options.swarm_workers != 0 ? options.swarm_workers : pool.size();
+    auto stop              = std::atomic<bool>{false};
+    auto mutex             = std::mutex{};
+    auto result            = std::optional<bool>{};
+    auto winner            = SwarmCounts{};
+    nba.visit([&]<typename _Set>(const BasicNBA<_Set> &nba) {
+        pool.run(num_workers, [&](std::size_t id) {
+            if (stop.load(std::memory_order_relaxed))
+                return;
+            auto worker       = SwarmWorker<_Set>{ts, nba, id, stop};
+            const auto answer = worker.can_run();
+            const auto lock   = std::scoped_lock{mutex};
+            if (!answer || result)
+                return;
+            result = answer;
+            winner = worker.counts();
+            stop.store(true, std::memory_order_relaxed);
+        });
+    });
+    assume(result.has_value(), "No swarm worker finished");
+    // the visited states of the worker which settled the answer. The probes of the NBA
+    // are only counted for the workers on the calling thread.
+    call_in_stats_mode([&] {
+        auto &stats          = query_stats();
+        stats.outer_visited += winner.outer_visited;
+        stats.inner_visited += winner.inner_visited;
+        stats.peak_stack     = std::max(stats.peak_stack, winner.peak_stack);
+    });
+    return *result;
+}
+
+} // namespace dark
@@ -1,15 +1,21 @@
 #include "LTL/error.h"
 #include "LTL/ts.h"
 #include "utils/bitset.h"
+#include "utils/error.h"
 #include "utils/irange.h"
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <istream>
 #include <iterator>
+#include <optional>
 #include <ostream>
+#include <span>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace dark {
@@ -31,30 +37,31 @@ auto TSGraph::read(std::istream &is) -> TSGraph {
         using T = decltype(tmp);
         std::ranges::copy(std::istream_iterator<T>{ss}, std::istream_iterator<T>{}, iter);
     };
-    auto initial_set   = std::vector<std::size_t>{};
-    const auto readset = [&initial_set](std::istream &is, bitset &set) {
-        initial_set.clear();
-        readrange(is, std::make_signed_t<std::size_t>{}, std::back_inserter(initial_set));
+    static constexpr auto readset = [](std::istream &is, std::size_t n) {
+        auto indices = std::vector<std::size_t>{};
+        readrange(is, std::make_signed_t<std::size_t>{}, std::back_inserter(indices));
         // empty set means all states
-        if (initial_set.size() == 1 && initial_set[0] == static_cast<std::size_t>(-1))
-            return;
-        for (const auto i : initial_set) {
-            docheck(i < set.size(), "initial state index out of range");
-            set[i] = true;
-        }
+        if (indices.size() == 1 && indices[0] == static_cast<std::size_t>(-1))
+            indices.clear();
+        for (const auto i : indices)
+            docheck(i < n, "initial state index out of range");
+        return indices;
     };
 
     auto result = TSGraph{};
     readline(is) >> result.num_states >> result.num_transitions;
-    result.initial_set = bitset{result.num_states};
-    readset(is, result.initial_set);
+    result.initial_set = readset(is, result.num_states);
     readrange(is, std::string{}, std::back_inserter(result.action_map));
     readrange(is, std::string{}, std::back_inserter(result.atomic_map));
     const auto kNumAP = result.atomic_map.size();
+    docheck(kNumAP <= 64, "at most 64 atomic propositions are supported");
     for ([[maybe_unused]] const auto _ : irange(result.num_transitions))
         readline(is) >> result.transitions.emplace_back();
-    for ([[maybe_unused]] const auto _ : irange(result.num_states))
-        readset(is, result.ap_sets.emplace_back(kNumAP));
+    for ([[maybe_unused]] const auto _ : irange(result.num_states)) {
+        auto &set = result.ap_sets.emplace_back(kNumAP);
+        for (const auto i : readset(is, kNumAP))
+            set[i] = true;
+    }
 
     result.post_init();
     return result;
@@ -64,21 +71,271 @@ auto TSGraph::post_init() -> void {
     atomic_rev_map.reserve(atomic_map.size());
     for (const auto &s : atomic_map)
         atomic_rev_map[s] = atomic_rev_map.size();
-    transition_list.assign(num_states, bitset{num_states});
+    build_adjacency();
+}
+
+auto TSGraph::build_adjacency() -> void {
+    transition_list.assign(num_states, {});
     for (const auto &[from, action, into] : transitions) {
         docheck(from < num_states, "transition from out of range");
         docheck(into < num_states, "transition to out of range");
         docheck(action < action_map.size(), "transition action out of range");
-        transition_list[from][into] = true;
+        transition_list[from].push_back(into);
+    }
+    // transitions with different actions may share the same target
+    for (auto &list : transition_list) {
+        std::ranges::sort(list);
+        const auto [first, last] = std::ranges::unique(list);
+        list.erase(first, last);
+    }
+    std::ranges::sort(initial_set);
+    const auto [first, last] = std::ranges::unique(initial_set);
+    initial_set.erase(first, last);
+    find_scc();
+
+    // distinct across all graphs, so that caches of one TS never serve another
+    static auto counter = std::atomic<std::uint64_t>{0};
+    generation          = ++counter;
+}
+
+// Iterative Tarjan, so that long chains of states do not overflow the call stack
+auto TSGraph::find_scc() -> void {
+    static constexpr auto kNone = static_cast<std::size_t>(-1);
+
+    struct Frame {
+        std::size_t state;
+        std::size_t next; // index of the next successor to visit
+    };
+
+    auto index    = std::vector<std::size_t>(num_states, kNone);
+    auto low      = std::vector<std::size_t>(num_states);
+    auto on_stack = std::vector<bool>(num_states);
+    auto stack    = std::vector<std::size_t>{};
+    auto frames   = std::vector<Frame>{};
+    auto counter  = std::size_t{};
+
+    scc_index.assign(num_states, kNone);
+    scc_cyclic.clear();
+    scc_live.clear();
+
+    const auto enter = [&](std::size_t v) {
+        index[v] = low[v] = counter++;
+        on_stack[v]       = true;
+        stack.push_back(v);
+        frames.push_back({v, 0});
+    };
+
+    for (const auto root : irange(num_states)) {
+        if (index[root] != kNone)
+            continue;
+        enter(root);
+        while (!frames.empty()) {
+            const auto v     = frames.back().state;
+            const auto &list = transition_list[v];
+            if (frames.back().next < list.size()) {
+                const auto w = list[frames.back().next++];
+                if (index[w] == kNone)
+                    enter(w);
+                else if (on_stack[w])
+                    low[v] = std::min(low[v], index[w]);
+                continue;
+            }
+
+            frames.pop_back();
+            if (!frames.empty()) {
+                const auto u = frames.back().state;
+                low[u]       = std::min(low[u], low[v]);
+            }
+            if (low[v] != index[v])
+                continue;
+
+            // v is the root of an SCC, which is cyclic if it has 2+ states or a self loop.
+            // It is live if cyclic, or if it has an edge to a live SCC, all of which are
+            // completed already (with a smaller id).
+            const auto id = scc_cyclic.size();
+            auto size     = std::size_t{};
+            auto w        = kNone;
+            auto live     = false;
+            do {
+                w = stack.back();
+                stack.pop_back();
+                on_stack[w]  = false;
+                scc_index[w] = id;
+                ++size;
+                for (const auto u : transition_list[w])
+                    live = live || (scc_index[u] < id && scc_live[scc_index[u]]);
+            } while (w != v);
+            const auto cyclic = size > 1 || std::ranges::binary_search(list, v);
+            scc_cyclic.push_back(cyclic);
+            scc_live.push_back(cyclic || live);
+        }
+    }
+}
+
+auto parse_state_order(std::string_view name) -> std::optional<StateOrder> {
+    if (name == "input")
+        return StateOrder::Input;
+    if (name == "bfs")
+        return StateOrder::BFS;
+    if (name == "dfs")
+        return StateOrder::DFS;
+    if (name == "rcm")
+        return StateOrder::RCM;
+    return std::nullopt;
+}
+
+namespace {
+
+// new id -> old id. Searches start from the initial states, then from any unvisited state.
+auto bfs_order(std::span<const std::vector<std::size_t>> adj, std::span<const std::size_t> roots)
+    -> std::vector<std::size_t> {
+    auto order   = std::vector<std::size_t>{};
+    auto visited = std::vector<bool>(adj.size());
+    order.reserve(adj.size());
+    const auto search = [&](std::size_t root) {
+        if (visited[root])
+            return;
+        visited[root] = true;
+        // the order itself is the queue
+        auto head = order.size();
+        order.push_back(root);
+        for (; head < order.size(); ++head) {
+            for (const auto w : adj[order[head]]) {
+                if (!visited[w]) {
+                    visited[w] = true;
+                    order.push_back(w);
+                }
+            }
+        }
+    };
+    for (const auto root : roots)
+        search(root);
+    for (const auto root : irange(adj.size()))
+        search(root);
+    return order;
+}
+
+auto dfs_order(std::span<const std::vector<std::size_t>> adj, std::span<const std::size_t> roots)
+    -> std::vector<std::size_t> {
+    struct Frame {
+        std::size_t state;
+        std::size_t next; // index of the next successor to visit
+    };
+    auto order   = std::vector<std::size_t>{};
+    auto visited = std::vector<bool>(adj.size());
+    auto frames  = std::vector<Frame>{};
+    order.reserve(adj.size());
+    const auto enter = [&](std::size_t v) {
+        visited[v] = true;
+        order.push_back(v);
+        frames.push_back({v, 0});
+    };
+    const auto search = [&](std::size_t root) {
+        if (visited[root])
+            return;
+        enter(root);
+        while (!frames.empty()) {
+            auto &[v, next] = frames.back();
+            if (next == adj[v].size()) {
+                frames.pop_back();
+            } else if (const auto w = adj[v][next++]; !visited[w]) {
+                enter(w);
+            }
+        }
+    };
+    for (const auto root : roots)
+        search(root);
+    for (const auto root : irange(adj.size()))
+        search(root);
+    return order;
+}
+
+// Reverse Cuthill-McKee: BFS over the undirected graph from a vertex of minimum degree,
+// visiting neighbours by increasing degree, and reversed at last
+auto rcm_order(std::span<const std::vector<std::size_t>> adj) -> std::vector<std::size_t> {
+    const auto n    = adj.size();
+    auto undirected = std::vector<std::vector<std::size_t>>(n);
+    for (const auto v : irange(n)) {
+        for (const auto w : adj[v]) {
+            if (v == w)
+                continue;
+            undirected[v].push_back(w);
+            undirected[w].push_back(v);
+        }
     }
+    for (auto &list : undirected) {
+        std::ranges::sort(list);
+        const auto [first, last] = std::ranges::unique(list);
+        list.erase(first, last);
+    }
+    const auto degree = [&](std::size_t v) { return undirected[v].size(); };
+    for (auto &list : undirected)
+        std::ranges::stable_sort(list, {}, degree);
+
+    auto by_degree = std::vector<std::size_t>(n);
+    for (const auto v : irange(n))
+        by_degree[v] = v;
+    std::ranges::stable_sort(by_degree, {}, degree);
+
+    auto order = bfs_order(undirected, by_degree);
+    std::ranges::reverse(order);
+    return order;
+}
+
+} // namespace
+
+auto TSGraph::reorder(StateOrder method) -> void {
+    auto order = std::vector<std::size_t>{}; // new id -> old id
+    switch (method) {
+        case StateOrder::Input: return;
+        case StateOrder::BFS:   order = bfs_order(transition_list, initial_set); break;
+        case StateOrder::DFS:   order = dfs_order(transition_list, initial_set); break;
+        case StateOrder::RCM:   order = rcm_order(transition_list); break;
+        default:                panic("Invalid state order");
+    }
+    assume(fairness.empty(), "Fairness is read after the states are renumbered");
+
+    auto rank = std::vector<std::size_t>(num_states); // old id -> new id
+    for (const auto i : irange(num_states))
+        rank[order[i]] = i;
+
+    for (auto &t : transitions) {
+        t.from = rank[t.from];
+        t.into = rank[t.into];
+    }
+    for (auto &i : initial_set)
+        i = rank[i];
+    auto new_ap_sets = std::vector<bitset>{};
+    new_ap_sets.reserve(num_states);
+    for (const auto i : irange(num_states))
+        new_ap_sets.push_back(ap_sets[order[i]]);
+    ap_sets = std::move(new_ap_sets);
+
+    // compose with any earlier renumbering
+    auto new_input_ids = std::vector<std::size_t>(num_states);
+    for (const auto i : irange(num_states))
+        new_input_ids[i] = to_input(order[i]);
+    input_ids = std::move(new_input_ids);
+    internal_ids.assign(num_states, 0);
+    for (const auto i : irange(num_states))
+        internal_ids[input_ids[i]] = i;
+
+    build_adjacency();
+}
+
+auto TSGraph::to_internal(std::size_t id) const -> std::size_t {
+    return internal_ids.empty() ? id : internal_ids[id];
+}
+
+auto TSGraph::to_input(std::size_t id) const -> std::size_t {
+    return input_ids.empty() ? id : input_ids[id];
 }
 
 auto TSGraph::debug(std::ostream &os) const -> void {
     os << num_states << ' ' << num_transitions << '\n';
     os << "initial_set: ";
-    for (const auto i : irange(initial_set.size()))
-        if (initial_set[i])
-            os << i << ' ';
+    for (const auto i : initial_set)
+        os << i << ' ';
     os << '\n';
     os << "action_map: ";
     for (const auto i : irange(action_map.size()))
@@ -96,4 +353,25 @@ auto TSGraph::debug(std::ostream &os) const -> void {
     }
 }
 
+auto TSGraph::print(std::ostream &os, const Lasso &lasso) const -> void {
+    const auto state = [&](std::size_t id) {
+        os << to_input(id) << " {";
+        auto first = true;
+        for (const auto i : irange(atomic_map.size()))
+            if (ap_sets[id][i])
+                os << (std::exchange(first, false) ? "" : " ") << atomic_map[i];
+        os << '}';
+    };
+    for (const auto id : lasso.prefix) {
+        state(id);
+        os << " -> ";
+    }
+    os << '[';
+    for (const auto i : irange(lasso.cycle.size())) {
+        os << (i == 0 ? "" : " -> ");
+        state(lasso.cycle[i]);
+    }
+    os << ']';
+}
+
 } // namespace dark
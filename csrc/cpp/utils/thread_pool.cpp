@@ -0,0 +1,96 @@
+#include "utils/thread_pool.h"
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+namespace dark {
+
+struct ThreadPool::Job {
+    std::function<void(std::size_t)> fn;
+    std::size_t num_tasks;
+    std::size_t next = 0; // the next task to hand out
+    std::size_t done = 0; // the tasks completed
+    std::exception_ptr error;
+};
+
+ThreadPool::ThreadPool(std::size_t num_threads) {
+    for (std::size_t i = 1; i < num_threads; ++i)
+        workers.emplace_back([this](std::stop_token token) { loop(std::move(token)); });
+}
+
+static auto global_pool() -> std::unique_ptr<ThreadPool> & {
+    static auto pool =
+        std::make_unique<ThreadPool>(std::max(std::thread::hardware_concurrency(), 1u));
+    return pool;
+}
+
+auto ThreadPool::global() -> ThreadPool & {
+    return *global_pool();
+}
+
+auto ThreadPool::configure(std::size_t num_threads) -> void {
+    global_pool() = std::make_unique<ThreadPool>(std::max<std::size_t>(num_threads, 1));
+}
+
+auto ThreadPool::run(std::size_t num_tasks, std::function<void(std::size_t)> fn) -> void {
+    if (workers.empty() || num_tasks <= 1) {
+        for (std::size_t i = 0; i < num_tasks; ++i)
+            fn(i);
+        return;
+    }
+    const auto job = std::make_shared<Job>(std::move(fn), num_tasks);
+    {
+        const auto lock = std::scoped_lock{mutex};
+        jobs.push_back(job);
+    }
+    wakeup.notify_all();
+    work(*job);
+    auto lock = std::unique_lock{mutex};
+    finished.wait(lock, [&job] { return job->done == job->num_tasks; });
+    if (job->error)
+        std::rethrow_exception(job->error);
+}
+
+// take the tasks of a job one by one, until all are handed out
+auto ThreadPool::work(Job &job) -> void {
+    auto lock = std::unique_lock{mutex};
+    while (job.next < job.num_tasks) {
+        const auto i = job.next++;
+        if (job.next == job.num_tasks)
+            std::erase_if(jobs, [&job](const auto &ptr) { return ptr.get() == &job; });
+        lock.unlock();
+        auto error = std::exception_ptr{};
+        try {
+            job.fn(i);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        lock.lock();
+        if (error && !job.error)
+            job.error = std::move(error);
+        if (++job.done == job.num_tasks)
+            finished.notify_all();
+    }
+}
+
+// the workers are joined before the other members are destroyed, as they are declared last
+auto ThreadPool::loop(std::stop_token token) -> void {
+    while (true) {
+        auto job = std::shared_ptr<Job>{};
+        {
+            auto lock = std::unique_lock{mutex};
+            if (!wakeup.wait(lock, token, [this] { return !jobs.empty(); }))
+                return;
+            job = jobs.front();
+        }
+        work(*job);
+    }
+}
+
+} // namespace dark
@@ -1,135 +1,516 @@
 #include "LTL/automa.h"
+#include "LTL/context.h"
 #include "LTL/node.h"
+#include "LTL/search.h"
+#include "LTL/stats.h"
 #include "LTL/ts.h"
+#include "product.h"
 #include "utils/bitset.h"
 #include "utils/error.h"
+#include "utils/irange.h"
+#include <algorithm>
 #include <bit>
 #include <cstddef>
+#include <cstdint>
 #include <format>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <ranges>
+#include <sstream>
 #include <stack>
+#include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace dark {
 
 namespace {
 
-struct ProductSystem {
+struct State {
+    std::size_t idx_ts;
+    std::size_t idx_nba;
+    [[maybe_unused]] // clangd false positive warning
+    friend auto
+    operator==(const State &lhs, const State &rhs) -> bool = default;
+};
+
+struct Hash {
+    auto operator()(const State &s) const -> std::size_t {
+        return std::rotl(s.idx_ts, 32) ^ s.idx_nba;
+    }
+};
+
+// A hash map of product states, with open addressing, which keeps its storage when
+// cleared. Each slot is stamped with the generation that filled it, so clear() starts
+// a new generation in O(1), and slots of older ones count as empty.
+template <typename _Value = std::monostate>
+struct StateTable {
 public:
-    struct State {
-        std::size_t idx_ts;
-        std::size_t idx_nba;
-        [[maybe_unused]] // clangd false positive warning
-        friend auto
-        operator==(const State &lhs, const State &rhs) -> bool = default;
+    auto clear() -> void {
+        num_used = 0;
+        if (++generation != 0)
+            return;
+        // the stamps wrapped around, so that an old slot might look filled
+        std::ranges::fill(stamps, 0);
+        generation = 1;
+    }
+
+    // the value of the state, and whether it was inserted, with the given value
+    auto try_emplace(const State &s, _Value value) -> std::pair<_Value *, bool> {
+        if (2 * (num_used + 1) > slots.size())
+            grow();
+        for (auto i = slot_of(s);; i = (i + 1) & (slots.size() - 1)) {
+            if (stamps[i] != generation) {
+                stamps[i] = generation;
+                slots[i]  = {s, std::move(value)};
+                ++num_used;
+                return {&slots[i].value, true};
+            }
+            if (slots[i].state == s)
+                return {&slots[i].value, false};
+        }
+    }
+
+    auto insert(const State &s) -> std::pair<_Value *, bool> {
+        return try_emplace(s, _Value{});
+    }
+
+private:
+    struct Slot {
+        State state;
+        [[no_unique_address]] _Value value;
     };
 
-    static auto can_run(const TSView &ts, const NBA &nba) -> bool;
+    // the weak bits of Hash are spread by a multiplicative hash
+    auto slot_of(const State &s) const -> std::size_t {
+        return (Hash{}(s) * 0x9E3779B97F4A7C15ull) >> shift;
+    }
+
+    // double the slots, at most half of which are used
+    auto grow() -> void {
+        const auto size = std::max(slots.size() * 2, kMinSize);
+        auto old_slots  = std::exchange(slots, std::vector<Slot>(size));
+        auto old_stamps = std::exchange(stamps, std::vector<std::uint32_t>(size));
+        const auto old  = std::exchange(generation, 1);
+        shift           = 64 - std::countr_zero(size);
+        num_used        = 0;
+        for (const auto i : irange(old_slots.size()))
+            if (old_stamps[i] == old)
+                try_emplace(old_slots[i].state, std::move(old_slots[i].value));
+    }
+
+    inline static constexpr auto kMinSize = std::size_t{64};
+
+    std::vector<Slot> slots;
+    std::vector<std::uint32_t> stamps; // slot -> generation which filled it
+    std::uint32_t generation = 1;
+    std::size_t num_used     = 0;
+    int shift                = 64;
+};
+
+// A DFS stack entry, with a cursor into the successors of its state: the current
+// group of TS successors, the TS state within it, and the next NBA target. The
+// expansion resumes where it stopped, so a state of degree d costs O(d) in total.
+template <typename _Set>
+struct Frame {
+    State state;
+    const LabelClasses::Group *group; // current group, up to last
+    const LabelClasses::Group *last;
+    const _Set *target;               // NBA targets of the group, null if not probed yet
+    std::size_t member;               // index of the TS state in the group
+    typename _Set::iterator next;     // next NBA target
+};
+
+template <typename _Set>
+using Frames = std::vector<Frame<_Set>>;
+
+// Tarjan data of a product state in weak_cycle, by DFS number
+struct TarjanInfo {
+    std::size_t low;
+    bool on_stack;
+    bool self_loop;
+};
+
+} // namespace
+
+struct VerificationContext::Buffers {
+public:
+    // the frames of the width of the running query, with those of another width dropped
+    template <typename _Set>
+    auto frames_of() -> Frames<_Set> & {
+        if (auto *result = std::get_if<Frames<_Set>>(&frames))
+            return *result;
+        return frames.emplace<Frames<_Set>>();
+    }
+
+    // label classes of one TS by used AP mask, see label_classes
+    std::unordered_map<std::uint64_t, LabelClasses> labels;
+    std::uint64_t labels_of = 0; // the generation of that TS
+    StateTable<> outer;             // visited states in outer DFS
+    StateTable<> inner;             // visited states in the running inner DFS
+    StateTable<std::size_t> index;  // weak_cycle: state -> DFS number
+    std::vector<TarjanInfo> info;   // weak_cycle: DFS number -> info
+    std::vector<std::size_t> stack; // weak_cycle: DFS numbers of the SCCs
+    std::vector<std::size_t> path;  // weak_cycle: DFS numbers of the frames
+    by_width<Frames> frames;        // outer frames, then inner frames
+
+    // conjuncts translated before, by canonical form (see debug_print): the GNBA of a
+    // safety formula (see safetyLTL), or else the NBA of its negation (see negateLTL).
+    // They are translated for this number of APs and engine, and with or without lassos.
+    std::unordered_map<std::string, std::variant<GNBA, NBA>> automata;
+    std::size_t num_atomics      = 0;
+    SearchOptions::Engine engine = SearchOptions::Engine::NestedDFS;
+    bool counterexample          = false;
+};
+
+// drop all the automata of a context once there are more distinct conjuncts; this is
+// the one automaton cache, also behind LTLProgram::serve
+inline constexpr auto kMaxAutomata = std::size_t{1024};
+// drop all the label classes of a context once there are more distinct masks
+inline constexpr auto kMaxLabelClasses = std::size_t{16};
+
+VerificationContext::VerificationContext() : impl(std::make_unique<Buffers>()) {}
+VerificationContext::~VerificationContext() = default;
+
+auto label_classes(VerificationContext &context, const TSView &ts, const bitset &used_ap_mask)
+    -> const LabelClasses & {
+    auto &buffers = context.buffers();
+    auto &cache   = buffers.labels;
+    if (buffers.labels_of != ts.generation) {
+        cache.clear();
+        buffers.labels_of = ts.generation;
+    }
+
+    // the classes and the rows of the states depend on the TS and the mask only,
+    // so a view of the same TS from other initial states rebuilds the last row
+    auto iter = cache.find(used_ap_mask.to_word());
+    if (iter != cache.end()) {
+        iter->second.assign_initial(ts);
+        return iter->second;
+    }
+    if (cache.size() >= kMaxLabelClasses)
+        cache.clear();
+    iter = cache.try_emplace(used_ap_mask.to_word()).first;
+    iter->second.assign(ts, used_ap_mask);
+    return iter->second;
+}
+
+namespace {
+
+template <typename _Set>
+struct ProductSystem {
+public:
+    using NBA   = BasicNBA<_Set>;
+    using Frame = dark::Frame<_Set>;
+
+    // record the lasso of an accepting cycle found, unless lasso is null
+    static auto can_run(
+        const LabelClasses &ts, const NBA &nba, VerificationContext::Buffers &,
+        std::optional<Lasso> *lasso
+    ) -> bool;
 
 private:
+    auto make_frame(State s) const -> Frame;
+    auto advance(Frame &f) const -> std::optional<State>;
+
+    // emptiness checks, by the strength of the NBA
+    auto reach_sink() -> bool;
+    auto weak_cycle() -> bool;
+    auto nested_dfs() -> bool;
+
     auto reachable_cycle(State s) -> bool;
     auto cycle_check(State s) -> bool;
+    auto record(std::size_t base) const -> void;
     auto brute_force() const -> bool;
 
-    ProductSystem(const TSView &ts, const NBA &nba);
-    const TSView &ts;
+    ProductSystem(
+        const LabelClasses &ts, const NBA &nba, VerificationContext::Buffers &,
+        std::optional<Lasso> *lasso
+    );
+    const LabelClasses &ts;
     const NBA &nba;
+    VerificationContext::Buffers &buffers;
+    std::optional<Lasso> *lasso;
 
-    struct Hash {
-        auto operator()(const State &s) const -> std::size_t {
-            return std::rotl(s.idx_ts, 32) ^ s.idx_nba;
-        }
-    };
-
-    std::unordered_set<State, Hash> R;       // visited states in outer DFS
-    std::stack<State, std::vector<State>> U; // stack for outer DFS
+    StateTable<> &R; // visited states in outer DFS
+    StateTable<> &T; // visited states in the running inner DFS
+    // frames of the outer DFS, with those of the running inner DFS on top of them.
+    // The storage is kept across queries, so no allocation once it is large enough.
+    Frames<_Set> &frames;
 };
 
-ProductSystem::ProductSystem(const TSView &ts, const NBA &nba) : ts{ts}, nba{nba} {}
+template <typename _Set>
+ProductSystem<_Set>::ProductSystem(
+    const LabelClasses &ts, const NBA &nba, VerificationContext::Buffers &buffers,
+    std::optional<Lasso> *lasso
+) :
+    ts{ts}, nba{nba}, buffers{buffers}, lasso{lasso}, R{buffers.outer}, T{buffers.inner},
+    frames{buffers.frames_of<_Set>()} {
+    R.clear();
+    frames.clear();
+}
 
 inline constexpr auto entry_pos = static_cast<std::size_t>(-1);
 
-// Whether an NBA accept at a state idx with atomic propositions AP as trigger
-auto accept(const NBA &nba, std::size_t idx, const bitset &AP) -> const bitset * {
-    const auto &map = nba.transitions[idx];
-    if (auto it = map.find(AP & nba.used_ap_mask); it != map.end())
-        return &it->second;
-    return nullptr;
-}
-
-auto ProductSystem::can_run(const TSView &ts, const NBA &nba) -> bool {
-    auto system = ProductSystem{ts, nba};
+template <typename _Set>
+auto ProductSystem<_Set>::can_run(
+    const LabelClasses &ts, const NBA &nba, VerificationContext::Buffers &buffers,
+    std::optional<Lasso> *lasso
+) -> bool {
+    auto system = ProductSystem{ts, nba, buffers, lasso};
     call_in_debug_mode([&] { system.brute_force(); });
-    for (const auto i : nba.initial_states)
-        if (system.reachable_cycle({entry_pos, i}))
-            return true;
-    return false;
+    // only the stacks of the nested DFS hold a whole lasso, which it finds for any NBA
+    if (lasso != nullptr && nba.strength != Strength::Empty)
+        return system.nested_dfs();
+    switch (nba.strength) {
+        case Strength::Empty:    return false;
+        case Strength::Terminal: return system.reach_sink();
+        case Strength::Weak:     return system.weak_cycle();
+        case Strength::Strong:   return system.nested_dfs();
+        default:                 panic("Invalid NBA strength");
+    }
 }
 
 #define for_each_post(input, ss, f)                                                                \
     do {                                                                                           \
         auto [idx_ts, idx_nba] = input;                                                            \
-        const auto &range      = (idx_ts == entry_pos) ? ts.initial_set : ts.transitions[idx_ts];  \
-        for (const auto t : range)                                                                 \
-            if (auto *target = accept(nba, idx_nba, ts.atomics[t]))                                \
-                for (const auto q : *target) {                                                     \
-                    const auto ss = State{t, q};                                                   \
-                    do                                                                             \
-                        f while (0);                                                               \
-                }                                                                                  \
+        const auto groups      = (idx_ts == entry_pos) ? ts.initial() : ts.post(idx_ts);           \
+        for (const auto &group : groups)                                                           \
+            if (auto *target = accept(nba, idx_nba, ts.label(group)))                              \
+                for (const auto t : ts.states(group))                                              \
+                    for (const auto q : *target) {                                                 \
+                        const auto ss = State{t, q};                                               \
+                        do                                                                         \
+                            f while (0);                                                           \
+                    }                                                                              \
     } while (0)
 
-auto ProductSystem::reachable_cycle(State input) -> bool {
-    U.push(input);
+// count a probe of the visited set, and whether it is a new state
+auto visit_stats(bool inserted, std::size_t QueryStats::*visited) -> void {
+    call_in_stats_mode([=] {
+        auto &stats = query_stats();
+        stats.hash_probes += 1;
+        stats.*visited += inserted;
+    });
+}
+
+auto stack_stats(std::size_t depth) -> void {
+    call_in_stats_mode([=] {
+        auto &stats      = query_stats();
+        stats.peak_stack = std::max(stats.peak_stack, depth);
+    });
+}
+
+template <typename _Set>
+auto ProductSystem<_Set>::make_frame(State s) const -> Frame {
+    const auto groups = (s.idx_ts == entry_pos) ? ts.initial() : ts.post(s.idx_ts);
+    return Frame{
+        .state  = s,
+        .group  = groups.data(),
+        .last   = groups.data() + groups.size(),
+        .target = nullptr,
+        .member = 0,
+        .next   = {},
+    };
+}
+
+// the next successor of the frame, in the same order as for_each_post
+template <typename _Set>
+auto ProductSystem<_Set>::advance(Frame &f) const -> std::optional<State> {
+    while (true) {
+        if (f.target != nullptr) {
+            const auto members = ts.states(*f.group);
+            if (f.next != f.target->end())
+                return State{members[f.member], *f.next++};
+            if (++f.member != members.size()) {
+                f.next = f.target->begin();
+                continue;
+            }
+            f.target = nullptr;
+            ++f.group;
+        }
+        for (; f.group != f.last; ++f.group)
+            if ((f.target = accept(nba, f.state.idx_nba, ts.label(*f.group))) != nullptr)
+                break;
+        if (f.target == nullptr)
+            return std::nullopt;
+        f.member = 0;
+        f.next   = f.target->begin();
+    }
+}
+
+// Terminal NBA: a run which leaves a sink state for a TS state with an infinite path
+// can stay among the sink states forever, so plain reachability suffices.
+template <typename _Set>
+auto ProductSystem<_Set>::reach_sink() -> bool {
+    for (const auto i : nba.initial_states) {
+        frames.push_back(make_frame({entry_pos, i}));
+        while (!frames.empty()) {
+            const auto cur = frames.back().state;
+            if (const auto s = advance(frames.back())) {
+                if (nba.sink_states[cur.idx_nba] && ts.is_live(s->idx_ts))
+                    return true;
+                const auto inserted = R.insert(*s).second;
+                visit_stats(inserted, &QueryStats::outer_visited);
+                if (inserted) {
+                    frames.push_back(make_frame(*s));
+                    stack_stats(frames.size());
+                }
+            } else {
+                frames.pop_back();
+            }
+        }
+    }
+    return false;
+}
+
+// Weak NBA: a cycle of the product stays in one SCC of the NBA, so it is accepting iff
+// that SCC is. One Tarjan pass over the product finds a cyclic SCC of it, if any,
+// whose NBA states are in an accepting SCC, with no nested search.
+template <typename _Set>
+auto ProductSystem<_Set>::weak_cycle() -> bool {
+    auto &index = buffers.index;
+    auto &info  = buffers.info;
+    auto &stack = buffers.stack;
+    auto &path  = buffers.path;
+    index.clear();
+    info.clear();
+    stack.clear();
+    path.clear();
+
+    // s is numbered info.size() already
+    const auto enter = [&](State s) {
+        const auto n = info.size();
+        info.push_back({n, true, false});
+        stack.push_back(n);
+        path.push_back(n);
+        frames.push_back(make_frame(s));
+        stack_stats(frames.size());
+    };
+
+    for (const auto i : nba.initial_states) {
+        if (!index.try_emplace({entry_pos, i}, info.size()).second)
+            continue;
+        enter({entry_pos, i});
+        while (!frames.empty()) {
+            const auto v = path.back();
+            if (const auto s = advance(frames.back())) {
+                const auto [number, inserted] = index.try_emplace(*s, info.size());
+                visit_stats(inserted, &QueryStats::outer_visited);
+                if (inserted) {
+                    enter(*s);
+                } else if (const auto w = *number; info[w].on_stack) {
+                    info[v].low       = std::min(info[v].low, w);
+                    info[v].self_loop = info[v].self_loop || w == v;
+                }
+                continue;
+            }
+
+            const auto cur = frames.back().state;
+            frames.pop_back();
+            path.pop_back();
+            if (!path.empty())
+                info[path.back()].low = std::min(info[path.back()].low, info[v].low);
+            if (info[v].low != v)
+                continue;
+
+            // cur is the root of an SCC of the product, made of the DFS numbers from v on
+            auto size = std::size_t{};
+            for (; !stack.empty() && stack.back() >= v; ++size) {
+                info[stack.back()].on_stack = false;
+                stack.pop_back();
+            }
+            if ((size > 1 || info[v].self_loop) && nba.accepting_sccs[cur.idx_nba])
+                return true;
+        }
+    }
+    return false;
+}
+
+template <typename _Set>
+auto ProductSystem<_Set>::nested_dfs() -> bool {
+    for (const auto i : nba.initial_states)
+        if (reachable_cycle({entry_pos, i}))
+            return true;
+    return false;
+}
+
+template <typename _Set>
+auto ProductSystem<_Set>::reachable_cycle(State input) -> bool {
+    frames.push_back(make_frame(input));
     R.insert(input);
-    do {
-        const auto cur     = U.top();
-        auto has_unvisited = false;
-        for_each_post(cur, s, {
-            if (R.insert(s).second) {
-                has_unvisited = true;
-                U.push(s);
+    while (!frames.empty()) {
+        if (const auto s = advance(frames.back())) {
+            const auto inserted = R.insert(*s).second;
+            visit_stats(inserted, &QueryStats::outer_visited);
+            if (inserted) {
+                frames.push_back(make_frame(*s));
+                stack_stats(frames.size());
             }
-        });
-        if (!has_unvisited) {
-            U.pop();
+        } else {
+            const auto cur = frames.back().state;
+            frames.pop_back();
             if (cycle_check(cur))
                 return true;
         }
-    } while (!U.empty());
+    }
     return false;
 }
 
-auto ProductSystem::cycle_check(State start) -> bool {
+template <typename _Set>
+auto ProductSystem<_Set>::cycle_check(State start) -> bool {
     const auto [idx_ts, idx_nba] = start;
-    if (idx_ts == entry_pos || !nba.final_states[idx_nba])
+    if (idx_ts == entry_pos || !nba.final_states[idx_nba] || !ts.on_cycle(idx_ts))
         return false;
 
-    std::unordered_set<State, Hash> T;       // visited states in inner DFS
-    std::stack<State, std::vector<State>> V; // stack for inner DFS
+    // a cycle through start never leaves the SCC of its TS state
+    const auto scc = ts.scc[idx_ts];
 
-    V.push(start);
+    // the inner DFS runs on top of the outer frames, and leaves them untouched
+    const auto base = frames.size();
+    frames.push_back(make_frame(start));
+    T.clear();
     T.insert(start);
-    do {
-        const auto cur     = V.top();
-        auto has_unvisited = false;
-        for_each_post(cur, s, {
-            if (s == start)
+    while (frames.size() != base) {
+        if (const auto s = advance(frames.back())) {
+            if (*s == start) {
+                if (lasso != nullptr)
+                    record(base);
+                frames.resize(base);
                 return true;
-            if (T.insert(s).second) {
-                has_unvisited = true;
-                V.push(s);
             }
-        });
-
-        if (!has_unvisited)
-            V.pop();
-    } while (!V.empty());
+            const auto inserted = ts.scc[s->idx_ts] == scc && T.insert(*s).second;
+            visit_stats(inserted, &QueryStats::inner_visited);
+            if (inserted) {
+                frames.push_back(make_frame(*s));
+                stack_stats(frames.size());
+            }
+        } else {
+            frames.pop_back();
+        }
+    }
     return false;
 }
 
-auto ProductSystem::brute_force() const -> bool {
+// The lasso of an accepting cycle through start, right when cycle_check closes it. The
+// outer frames below base are the path from the virtual initial node to the parent of
+// start, which reachable_cycle popped, and those from base on the inner path from start.
+template <typename _Set>
+auto ProductSystem<_Set>::record(std::size_t base) const -> void {
+    auto &result = lasso->emplace();
+    for (const auto i : irange(std::size_t{1}, base))
+        result.prefix.push_back(frames[i].state.idx_ts);
+    for (const auto i : irange(base, frames.size()))
+        result.cycle.push_back(frames[i].state.idx_ts);
+}
+
+template <typename _Set>
+auto ProductSystem<_Set>::brute_force() const -> bool {
     auto initial_states = std::vector<State>{};
     for (const auto i : nba.initial_states) {
         const auto cur = State{entry_pos, i};
@@ -201,15 +582,187 @@ auto ProductSystem::brute_force() const -> bool {
     return false;
 }
 
+// Formulas decided without any TS, by canonical form (see debug_print). Shared by all
+// the queries, so that a guard repeated across a property suite is translated once.
+struct Verdicts {
+public:
+    auto find(const std::string &key) -> std::optional<Satisfiability> {
+        const auto lock = std::scoped_lock{mutex};
+        const auto iter = map.find(key);
+        return iter == map.end() ? std::nullopt : std::optional{iter->second};
+    }
+
+    auto insert(std::string key, Satisfiability verdict) -> void {
+        // drop them all once there are too many distinct formulas
+        static constexpr auto kMaxSize = std::size_t{4096};
+        if (verdict == Satisfiability::Contingent)
+            return;
+        const auto lock = std::scoped_lock{mutex};
+        if (map.size() >= kMaxSize)
+            map.clear();
+        map.try_emplace(std::move(key), verdict);
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, Satisfiability> map;
+};
+
+auto verdicts() -> Verdicts & {
+    static auto instance = Verdicts{};
+    return instance;
+}
+
 } // namespace
 
-auto verifyLTL(BaseNode *node, const TSView &ts) -> bool {
+auto decided(Satisfiability satisfiability, const TSView &ts) -> std::optional<bool> {
+    switch (satisfiability) {
+        case Satisfiability::Valid: return true;
+        // no path satisfies it, so it holds iff every path from the initial states deadlocks
+        case Satisfiability::Unsatisfiable:
+            return std::ranges::none_of(ts.initial_set, [&ts](std::size_t i) {
+                return ts.live[ts.scc[i]] != 0;
+            });
+        case Satisfiability::Contingent: return std::nullopt;
+        default:                         panic("Invalid satisfiability");
+    }
+}
+
+auto negateLTL(BaseNode *node, std::size_t num_atomics) -> NBA {
+    auto &stats = query_stats();
     // build the GNBA of the reverse LTL formula
-    const auto GNBA_ = GNBA::build(node, ts.num_atomics, /*negate=*/true);
+    const auto GNBA_ = [&] {
+        const auto timer = StatsTimer{stats.translate_ms};
+        return GNBA::build(node, num_atomics, /*negate=*/true);
+    }();
     // convert GNBA to NBA
-    const auto NBA_ = NBA::fromGNBA(GNBA_);
+    auto NBA_ = [&] {
+        const auto timer = StatsTimer{stats.degeneralize_ms};
+        return NBA::fromGNBA(GNBA_);
+    }();
+    call_in_stats_mode([&] {
+        stats.gnba_states += GNBA_.num_states();
+        stats.gnba_edges  += GNBA_.num_edges();
+        stats.nba_states  += NBA_.num_states();
+        stats.nba_edges   += NBA_.num_edges();
+    });
+    return NBA_;
+}
+
+auto verifyLTL(
+    const NBA &nba, const TSView &ts, const SearchOptions &options, VerificationContext &context
+) -> bool {
+    const auto timer = StatsTimer{query_stats().search_ms};
+    context.lasso.reset();
+    // a violation still needs the search, for its lasso
+    if (const auto result = decided(nba.satisfiability, ts))
+        if (*result || !options.counterexample)
+            return *result;
+    // no cycle of the NBA is accepting, so neither is any cycle of the product
+    if (nba.strength() == Strength::Empty)
+        return true;
     // use product system to verify the LTL formula
-    return ProductSystem::can_run(ts, NBA_) ? false : true;
+    const auto &labels = label_classes(context, ts, nba.used_ap_mask());
+    // only fair cycles count, which the other engines cannot tell apart. A terminal NBA
+    // still needs none, as a sink accepts any fair path from a live state, see TSGraph.
+    if (!ts.fairness.empty() && nba.strength() != Strength::Terminal)
+        return !fair_can_run(labels, nba);
+    if (options.engine == SearchOptions::Engine::External)
+        return !external_can_run(labels, nba, options);
+    if (options.engine == SearchOptions::Engine::BitParallel) {
+        if (nba.num_states() <= kMaxBitwiseStates)
+            return !bitwise_can_run(labels, nba);
+        // tell once, as a stream of queries may repeat it for every large NBA
+        static auto once = std::once_flag{};
+        std::call_once(once, [&nba] {
+            std::cerr << std::format(
+                "note: --bit-parallel handles NBAs of at most {} states, so one of {} states "
+                "is searched by nested DFS\n",
+                kMaxBitwiseStates, nba.num_states()
+            );
+        });
+    }
+    if (options.engine == SearchOptions::Engine::Swarm)
+        return !swarm_can_run(labels, nba, options);
+    if (options.engine == SearchOptions::Engine::Parallel)
+        return !parallel_can_run(labels, nba);
+    if (options.engine == SearchOptions::Engine::Distributed)
+        return !distributed_can_run(labels, nba, options);
+    auto *lasso        = options.counterexample ? &context.lasso : nullptr;
+    const auto can_run = nba.visit([&]<typename _Set>(const BasicNBA<_Set> &nba) {
+        return ProductSystem<_Set>::can_run(labels, nba, context.buffers(), lasso);
+    });
+    return can_run ? false : true;
+}
+
+namespace {
+
+auto verify_conjunct(
+    BaseNode *node, const TSView &ts, const SearchOptions &options, VerificationContext &context
+) -> bool {
+    // a formula seen valid or unsatisfiable before needs no translation at all
+    auto key = std::ostringstream{};
+    node->debug_print(key);
+    if (const auto verdict = verdicts().find(key.str()))
+        if (const auto result = decided(*verdict, ts).value(); result || !options.counterexample)
+            return result;
+
+    // a formula translated before for this context is not translated again
+    auto &buffers  = context.buffers();
+    auto &automata = buffers.automata;
+    if (buffers.num_atomics != ts.num_atomics || buffers.engine != options.engine
+        || buffers.counterexample != options.counterexample) {
+        automata.clear();
+        buffers.num_atomics    = ts.num_atomics;
+        buffers.engine         = options.engine;
+        buffers.counterexample = options.counterexample;
+    }
+    auto iter = automata.find(key.str());
+    if (iter == automata.end()) {
+        if (automata.size() >= kMaxAutomata)
+            automata.clear();
+        // a safety formula needs no cycle search, nor degeneralization
+        if (auto gnba = safetyLTL(node, ts.num_atomics, options)) {
+            verdicts().insert(key.str(), gnba->satisfiability);
+            iter = automata.try_emplace(key.str(), std::move(*gnba)).first;
+        } else {
+            auto nba = negateLTL(node, ts.num_atomics);
+            verdicts().insert(key.str(), nba.satisfiability);
+            iter = automata.try_emplace(key.str(), std::move(nba)).first;
+        }
+    }
+
+    if (const auto *gnba = std::get_if<GNBA>(&iter->second)) {
+        const auto result = verifySafety(*gnba, ts, context);
+        call_in_debug_mode([&] {
+            const auto nba    = negateLTL(node, ts.num_atomics);
+            const auto expect = verifyLTL(nba, ts, options, context);
+            assume(result == expect, "Safety check disagrees with the NBA");
+        });
+        return result;
+    }
+    return verifyLTL(std::get<NBA>(iter->second), ts, options, context);
+}
+
+} // namespace
+
+auto verifyLTL(
+    BaseNode *node, const TSView &ts, const SearchOptions &options, VerificationContext &context
+) -> bool {
+    // the elementary sets of a conjunction are the product of those of its conjuncts,
+    // so each conjunct is translated alone, and the first violated one settles it
+    context.lasso.reset();
+    const auto conjuncts = splitLTL(node);
+    if (conjuncts.size() == 1)
+        return verify_conjunct(node, ts, options, context);
+    const auto result = std::ranges::all_of(conjuncts, [&](const NodePtr &conjunct) {
+        return verify_conjunct(conjunct.get(), ts, options, context);
+    });
+    call_in_debug_mode([&] {
+        const auto expect = verify_conjunct(node, ts, options, context);
+        assume(result == expect, "Conjuncts disagree with the whole formula");
+    });
+    return result;
 }
 
 } // namespace dark
@@ -1,21 +1,27 @@
 #pragma once
 #include "node.h"
 #include "utils/bitset.h"
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <unordered_map>
+#include <utility>
+#include <variant>
 #include <vector>
 
 namespace dark {
 
-struct Automa {
+// _Set is the type of the state sets, see dispatch_bitset
+template <typename _Set>
+struct BasicAutoma {
     std::size_t num_states;   // states
     std::size_t num_triggers; // triggers (= num ap)
 
     // mapping: (trigger -> all potential next states)
-    using EdgeMap = std::unordered_map<bitset, bitset>;
+    using EdgeMap = std::unordered_map<bitset, _Set>;
 
     // state index -> (which state can be reached next)
-    bitset initial_states;
+    _Set initial_states;
     std::vector<EdgeMap> transitions;
 
     // only use the AP that appear in the formula
@@ -23,18 +29,132 @@ struct Automa {
 
     // try to validate. if false, throw an exception
     auto validate() const -> void;
+    // total number of (state, trigger, next state) edges
+    auto num_edges() const -> std::size_t;
 };
 
-struct GNBA;
+// What a formula says about the infinite words, whatever the TS
+enum class Satisfiability {
+    Valid,         // every word satisfies it
+    Unsatisfiable, // no word satisfies it
+    Contingent,    // anything else
+};
 
-struct NBA : Automa {
-    static auto fromGNBA(const GNBA &) -> NBA;
-    bitset final_states;
+// Successor lookup by the valuation of the used APs, built once from the EdgeMaps.
+// With few used APs, a dense array is indexed by the compressed valuation (PEXT over
+// the used AP mask), so a lookup is one load. Otherwise, a sorted flat map per state.
+template <typename _Set>
+struct TransitionTable {
+public:
+    static auto build(const BasicAutoma<_Set> &) -> TransitionTable;
+
+    auto find(std::size_t idx, const bitset &AP) const -> const _Set * {
+        return find(idx, AP, dense ? pext(AP.to_word() & mask, mask) : 0);
+    }
+    // the same, with AP also compressed to the used APs as pext(AP & mask, mask)
+    auto find(std::size_t idx, const bitset &AP, std::uint64_t compressed) const -> const _Set * {
+        if (dense) {
+            const auto slot = slots[(idx << num_used) | compressed];
+            return slot == kNone ? nullptr : &targets[slot];
+        }
+        const auto key   = AP.to_word() & mask;
+        const auto first = keys.begin() + offsets[idx];
+        const auto last  = keys.begin() + offsets[idx + 1];
+        const auto it    = std::lower_bound(first, last, key);
+        return (it != last && *it == key) ? &targets[it - keys.begin()] : nullptr;
+    }
+
+private:
+    inline static constexpr auto kNone = ~std::uint32_t{};
+
+    std::uint64_t mask   = 0;         // used AP mask
+    std::size_t num_used = 0;         // number of used APs
+    bool dense           = false;     // indexed by slots, or by offsets and keys
+    std::vector<_Set> targets;        // dense: distinct slots; flat: parallel to keys
+    std::vector<std::uint32_t> slots; // dense: (idx, compressed valuation) -> target
+    std::vector<std::size_t> offsets; // flat: idx -> range of keys
+    std::vector<std::uint64_t> keys;  // flat: sorted valuations of each state
+};
+
+template <typename _Set>
+struct BasicGNBA : BasicAutoma<_Set> {
+    std::vector<_Set> final_states_list;
+    TransitionTable<_Set> table; // built only for a safety check, see safetyLTL
+
+    // decide the formula by the language emptiness of the automaton alone,
+    // where negate tells whether the GNBA was built from its negation
+    auto decide(bool negate) const -> Satisfiability;
+    // drop the states unreachable from the initial ones, or in no accepting run
+    auto trim() -> void;
+};
+
+// How the accepting cycles of an NBA lie in its SCCs, from the cheapest emptiness
+// check of the product to the most general one
+enum class Strength {
+    Empty,    // no cycle visits a final state, so the language is empty
+    Terminal, // final states on cycles are sinks: a run reaching one is accepted
+    Weak,     // in each SCC, either every cycle visits a final state or none does
+    Strong,   // anything else
+};
+
+template <typename _Set>
+struct BasicNBA : BasicAutoma<_Set> {
+    static auto fromGNBA(const BasicGNBA<_Set> &) -> BasicNBA;
+    _Set final_states;
+    TransitionTable<_Set> table; // built from the transitions
+
+    // classified from the SCCs, after the transitions are built
+    Strength strength = Strength::Strong;
+    _Set sink_states;    // final states which can accept any continuation
+    _Set accepting_sccs; // states in a cyclic SCC whose cycles all visit a final state
 };
 
-struct GNBA : Automa {
+// one alternative for each width of dispatch_bitset
+template <template <typename> typename _Tp>
+using by_width = std::variant<
+    _Tp<basic_bitset<64>>, _Tp<basic_bitset<128>>, _Tp<basic_bitset<256>>,
+    _Tp<basic_bitset<512>>, _Tp<dynamic_bitset>>;
+
+// The width of the state sets is picked once per formula, large enough for
+// both the GNBA and the NBA degeneralized from it.
+template <template <typename> typename _Tp>
+struct AnyAutoma {
+    by_width<_Tp> impl;
+
+    template <typename _Fn>
+    auto visit(_Fn &&fn) const -> decltype(auto) {
+        return std::visit(std::forward<_Fn>(fn), impl);
+    }
+
+    auto num_states() const -> std::size_t {
+        return visit([](const auto &a) { return a.num_states; });
+    }
+
+    auto num_edges() const -> std::size_t {
+        return visit([](const auto &a) { return a.num_edges(); });
+    }
+
+    auto used_ap_mask() const -> const bitset & {
+        return visit([](const auto &a) -> const bitset & { return a.used_ap_mask; });
+    }
+};
+
+struct GNBA : AnyAutoma<BasicGNBA> {
     static auto build(BaseNode *, std::size_t, bool negate) -> GNBA;
-    std::vector<bitset> final_states_list;
+
+    // of the formula, never of its negation
+    Satisfiability satisfiability = Satisfiability::Contingent;
+};
+
+struct NBA : AnyAutoma<BasicNBA> {
+    static auto fromGNBA(const GNBA &) -> NBA;
+
+    auto strength() const -> Strength {
+        return visit([](const auto &a) { return a.strength; });
+    }
+
+    // copied from the GNBA, see GNBA::satisfiability
+    Satisfiability satisfiability = Satisfiability::Contingent;
 };
 
 } // namespace dark
@@ -0,0 +1,31 @@
+#pragma once
+#include "ts.h"
+#include <memory>
+#include <optional>
+
+namespace dark {
+
+// Scratch storage of the product searches, kept from one query to the next: the label
+// classes of the TS, the visited tables and the DFS stacks. The label classes are kept
+// per used AP mask, so a query rebuilds only their row of the initial states; the tables
+// and stacks are reset in O(1) and reuse their capacity, so a stream of small queries
+// stops allocating once the buffers have grown to its largest product. Used by one query
+// at a time.
+struct VerificationContext {
+public:
+    VerificationContext();
+    ~VerificationContext();
+
+    struct Buffers; // see verifier.cpp
+    auto buffers() -> Buffers & {
+        return *impl;
+    }
+
+    // the lasso of the last violation, if asked for (see SearchOptions::counterexample)
+    std::optional<Lasso> lasso;
+
+private:
+    std::unique_ptr<Buffers> impl;
+};
+
+} // namespace dark
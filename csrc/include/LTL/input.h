@@ -1,10 +1,29 @@
 #pragma once
+#include "search.h"
+#include "stats.h"
+#include "ts.h"
 #include <iosfwd>
 
 namespace dark {
 
+struct LTLOptions {
+    // if not null, export the statistics of each query (requires IN_STATS)
+    std::ostream *stats      = nullptr;
+    StatsFormat stats_format = StatsFormat::JSON;
+    // which engine searches the product system
+    SearchOptions search;
+    // renumbering of the TS states after loading
+    StateOrder order = StateOrder::Input;
+    // if not null, fairness assumptions on the TS (see TSGraph::read_fairness)
+    std::istream *fairness = nullptr;
+};
+
 struct LTLProgram {
-    static auto work(std::istream &ts, std::istream &ltl, std::ostream &os) -> void;
+    static auto work(std::istream &ts, std::istream &ltl, std::ostream &os, const LTLOptions & = {})
+        -> void;
+    // keep the TS resident and answer line-based queries until the input is closed
+    static auto serve(std::istream &ts, std::istream &is, std::ostream &os, const LTLOptions & = {})
+        -> void;
 };
 
 } // namespace dark
@@ -1,10 +1,17 @@
 #pragma once
+#include <cstddef>
 #include <iosfwd>
 #include <memory>
+#include <optional>
+#include <vector>
 
 namespace dark {
 
 struct TSView;
+struct GNBA;
+struct NBA;
+struct SearchOptions;
+struct VerificationContext;
 
 struct BaseNode {
     virtual ~BaseNode() = default;
@@ -22,7 +29,31 @@ struct BaseNode {
 
 using NodePtr = std::unique_ptr<BaseNode>;
 
+// the buffers of the search come from the context, which is reused across queries
 [[nodiscard]]
-auto verifyLTL(BaseNode *, const TSView &ts) -> bool;
+auto verifyLTL(BaseNode *, const TSView &ts, const SearchOptions &, VerificationContext &) -> bool;
+
+// split a formula into conjuncts which all hold iff it holds, cheapest to translate first.
+// G and X are pushed through conjunctions, e.g. G (a /\ X b) into G a and G X b.
+[[nodiscard]]
+auto splitLTL(const BaseNode *) -> std::vector<NodePtr>;
+
+// build the NBA of the negated formula, which can be reused across queries
+[[nodiscard]]
+auto negateLTL(BaseNode *, std::size_t num_atomics) -> NBA;
+
+// verify with a prebuilt NBA of the negated formula (see negateLTL)
+[[nodiscard]]
+auto verifyLTL(const NBA &, const TSView &ts, const SearchOptions &, VerificationContext &) -> bool;
+
+// build the GNBA of a syntactic safety formula, whose blocked runs are its bad prefixes.
+// nullopt if the formula is not a safety one, or the search must stay in external memory,
+// or a lasso is asked for (see SearchOptions::counterexample).
+[[nodiscard]]
+auto safetyLTL(BaseNode *, std::size_t num_atomics, const SearchOptions &) -> std::optional<GNBA>;
+
+// verify by plain reachability of a bad prefix, with a prebuilt GNBA (see safetyLTL)
+[[nodiscard]]
+auto verifySafety(const GNBA &, const TSView &ts, VerificationContext &) -> bool;
 
 } // namespace dark
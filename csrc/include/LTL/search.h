@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace dark {
+
+// How to search the product system for an accepting cycle
+struct SearchOptions {
+    enum class Engine {
+        NestedDFS,   // in-memory nested depth-first search
+        External,    // external-memory BFS with OWCTY, for products larger than memory
+        BitParallel, // NBA state masks per TS state, for NBAs of at most 64 states
+        Swarm,       // nested DFS workers in different random orders, the first one settles it
+        Parallel,    // parallel BFS of the whole product, then OWCTY with parallel levels
+        Distributed, // worker processes owning a hash partition each, OWCTY in lockstep
+    };
+
+    Engine engine = Engine::NestedDFS;
+
+    // record the lasso of each violation in the context (see VerificationContext), read off
+    // the stacks of the nested DFS. Only with that engine, and without fairness.
+    bool counterexample = false;
+
+    // external engine: directory of the spilled sorted runs,
+    // and the number of states buffered in memory before spilling
+    std::string external_dir;
+    std::size_t memory_states = std::size_t{1} << 24;
+
+    // swarm engine: the number of workers, or 0 for one per thread of the pool
+    std::size_t swarm_workers = 0;
+
+    // distributed engine: the number of worker processes, including the calling one
+    std::size_t distributed_workers = 1;
+};
+
+} // namespace dark
@@ -0,0 +1,85 @@
+#pragma once
+#include <chrono>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <utility>
+
+namespace dark {
+
+inline constexpr auto IN_STATS =
+#ifdef _DARK_STATS
+    true
+#else
+    false
+#endif
+    ;
+
+template <std::invocable _Fn>
+[[gnu::always_inline]]
+inline auto call_in_stats_mode(_Fn &&fn) -> void {
+    if constexpr (IN_STATS)
+        std::invoke(std::forward<_Fn>(fn));
+}
+
+// Counters of a single query. They are only collected when compiled with _DARK_STATS.
+struct QueryStats {
+    std::size_t query;   // 0-based index of the query
+    std::string initial; // "all" for the initial set of the TS, otherwise the single state
+    bool result;
+
+    std::size_t set_candidates; // partial sets explored by SetBuilder
+    std::size_t set_accepted;   // elementary sets accepted by SetBuilder
+    std::size_t gnba_states;    // automaton sizes, summed over the conjuncts (see splitLTL)
+    std::size_t gnba_edges;
+    std::size_t nba_states;
+    std::size_t nba_edges;
+    std::size_t outer_visited; // product states visited by the outer DFS
+    std::size_t inner_visited; // product states visited by all the inner DFS
+    std::size_t hash_probes;   // lookups in visited sets and automaton edge maps
+    std::size_t peak_stack;    // max depth of the DFS frame stack (outer and inner)
+
+    // wall time in milliseconds
+    double ts_parse_ms;
+    double parse_ms;
+    double translate_ms;
+    double degeneralize_ms;
+    double search_ms;
+};
+
+// the statistics of the running query in the current thread
+auto query_stats() -> QueryStats &;
+
+enum class StatsFormat { JSON, CSV };
+
+// JSON writes one object per line, CSV writes the header before the first record
+auto write_stats(std::ostream &, StatsFormat, const QueryStats &) -> void;
+
+// add the wall time of the scope to the counter in stats mode
+struct StatsTimer {
+public:
+    [[gnu::always_inline]]
+    explicit StatsTimer(double &target) : target(target) {
+        if constexpr (IN_STATS)
+            start = std::chrono::steady_clock::now();
+    }
+
+    [[gnu::always_inline]]
+    ~StatsTimer() {
+        if constexpr (IN_STATS) {
+            const auto finish = std::chrono::steady_clock::now();
+            target += std::chrono::duration<double, std::milli>(finish - start).count();
+        }
+    }
+
+    StatsTimer(const StatsTimer &)                     = delete;
+    auto operator=(const StatsTimer &) -> StatsTimer & = delete;
+
+private:
+    double &target;
+    std::chrono::steady_clock::time_point start;
+};
+
+} // namespace dark
@@ -1,17 +1,66 @@
 #pragma once
 #include "utils/bitset.h"
 #include <cstddef>
+#include <cstdint>
 #include <iosfwd>
 #include <optional>
+#include <span>
+#include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace dark {
 
+// How to renumber the states of a TS after loading, for memory locality
+enum class StateOrder {
+    Input, // as in the input
+    BFS,   // breadth-first from the initial states
+    DFS,   // depth-first preorder from the initial states
+    RCM,   // reverse Cuthill-McKee on the undirected graph
+};
+
+// "input", "bfs", "dfs" or "rcm"
+auto parse_state_order(std::string_view) -> std::optional<StateOrder>;
+
+// A fairness assumption: a path counts only if it takes the assumption infinitely often
+// whenever it is enabled forever from some point on (weak), or infinitely often (strong).
+// It is either an action, enabled where it labels an outgoing transition and taken along
+// such one, or a pair of atomic propositions, enabled where the first one holds and taken
+// into a state where the second one holds.
+struct Fairness {
+    enum class Kind {
+        Weak,   // F G enabled -> G F taken
+        Strong, // G F enabled -> G F taken
+    };
+
+    Kind kind;
+    std::vector<std::uint8_t> enabled;           // state -> whether enabled there
+    std::vector<std::vector<std::size_t>> taken; // state -> successors taking it, sorted
+
+    auto is_taken(std::size_t from, std::size_t into) const -> bool;
+};
+
+// An infinite path of a TS: the prefix from an initial state, then the cycle forever,
+// back to its first state after its last one. By internal state ids.
+struct Lasso {
+    std::vector<std::size_t> prefix;
+    std::vector<std::size_t> cycle;
+};
+
 struct TSGraph {
 public:
     static auto read(std::istream &) -> TSGraph;
 
+    // renumber the states, so that neighbours are close in memory
+    auto reorder(StateOrder) -> void;
+    // read fairness assumptions, one per line: "weak|strong action" or
+    // "weak|strong enabled taken" with atomic propositions (or true). After reorder.
+    auto read_fairness(std::istream &) -> void;
+    // map the state ids of the input to the internal ones, and back
+    auto to_internal(std::size_t) const -> std::size_t;
+    auto to_input(std::size_t) const -> std::size_t;
+
     struct Transition {
         std::size_t from;
         std::size_t action;
@@ -19,13 +68,16 @@ public:
     };
 
     auto debug(std::ostream &) const -> void;
+    // print a lasso on one line, by input state ids with their atomic propositions,
+    // e.g. "0 {a} -> 2 {} -> [1 {a b} -> 3 {b}]" with the cycle in brackets
+    auto print(std::ostream &, const Lasso &) const -> void;
     // map an atomic proposition to its index
     auto map_atomic(std::string_view) const -> std::size_t;
 
 private:
     std::size_t num_states;
     std::size_t num_transitions;
-    bitset initial_set;
+    std::vector<std::size_t> initial_set;
 
     std::vector<std::string> action_map; // action
     std::vector<std::string> atomic_map; // atomic proposition
@@ -34,25 +86,41 @@ private:
 
     // Post init function and post init data
     auto post_init() -> void;
-    std::vector<bitset> transition_list;
+    auto build_adjacency() -> void;
+    auto find_scc() -> void;
+    std::vector<std::vector<std::size_t>> transition_list; // sorted, no duplicates
     std::unordered_map<std::string_view, std::size_t> atomic_rev_map;
+    std::vector<std::size_t> scc_index;    // state -> SCC, in reverse topological order
+    std::vector<std::uint8_t> scc_cyclic;  // SCC -> whether it contains a cycle
+    std::vector<std::uint8_t> scc_live;    // SCC -> whether an infinite (fair) path starts in it
+    std::vector<std::size_t> input_ids;    // internal id -> input id, empty if not reordered
+    std::vector<std::size_t> internal_ids; // input id -> internal id, empty if not reordered
+    std::vector<Fairness> fairness;        // assumptions on the infinite paths
+    std::uint64_t generation = 0;          // new whenever the states are (re)built
     friend struct TSView;
 };
 
 struct TSView {
-    TSView(const TSGraph &, std::optional<bitset> = std::nullopt);
+    TSView(const TSGraph &, std::optional<std::vector<std::size_t>> = std::nullopt);
 
-    std::size_t num_states;  // number of states
-    std::size_t num_atomics; // number of atomic propositions
+    std::size_t num_states;   // number of states
+    std::size_t num_atomics;  // number of atomic propositions
+    std::uint64_t generation; // identifies the states, transitions and labels of the TS
 
-    bitset initial_set;                  // set of initial state
-    std::span<const bitset> transitions; // state -> set of states
-    std::span<const bitset> atomics;     // state -> set of atomic propositions
+    std::vector<std::size_t> initial_set;                  // set of initial state
+    std::span<const std::vector<std::size_t>> transitions; // state -> list of states
+    std::span<const bitset> atomics;                       // state -> set of atomic propositions
+    std::span<const std::size_t> scc;                      // state -> SCC
+    std::span<const std::uint8_t> cyclic;                  // SCC -> whether it contains a cycle
+    std::span<const std::uint8_t> live;                    // SCC -> whether it has a fair path
+    std::span<const Fairness> fairness;                    // only fair paths count, if any
 };
 
-inline TSView::TSView(const TSGraph &graph, std::optional<bitset> new_init) :
+inline TSView::TSView(const TSGraph &graph, std::optional<std::vector<std::size_t>> new_init) :
     num_states(graph.num_states), num_atomics(graph.atomic_map.size()),
+    generation(graph.generation),
     initial_set(std::move(new_init).value_or(graph.initial_set)),
-    transitions(graph.transition_list), atomics(graph.ap_sets) {}
+    transitions(graph.transition_list), atomics(graph.ap_sets), scc(graph.scc_index),
+    cyclic(graph.scc_cyclic), live(graph.scc_live), fairness(graph.fairness) {}
 
 } // namespace dark
@@ -1,5 +1,7 @@
 #pragma once
 #include "error.h"
+#include <algorithm>
+#include <bit>
 #include <bitset>
 #include <concepts>
 #include <cstddef>
@@ -7,10 +9,16 @@
 #include <functional>
 #include <ranges>
 #include <string>
+#include <type_traits>
 #include <vector>
 
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+
 namespace dark {
 
+// unbounded fallback with the same interface as basic_bitset
 struct dynamic_bitset {
 public:
     using word_t = std::uint64_t;
@@ -18,15 +26,64 @@ public:
     inline static constexpr auto kMask = ~static_cast<word_t>(0);
 
     dynamic_bitset() = default;
-    dynamic_bitset(std::size_t length) : m_length(length), m_data(s_required(length), 0) {}
-    dynamic_bitset(std::size_t length, bool value) :
-        m_length(length), m_data(s_required(length), value ? kMask : 0) {}
+    explicit dynamic_bitset(std::size_t length) :
+        m_length(length), m_data(s_required(length), 0) {}
+    explicit dynamic_bitset(std::size_t length, bool value) :
+        m_length(length), m_data(s_required(length), value ? kMask : 0) {
+        m_trim();
+    }
 
     dynamic_bitset(const dynamic_bitset &)                     = default;
     dynamic_bitset(dynamic_bitset &&)                          = default;
     auto operator=(const dynamic_bitset &) -> dynamic_bitset & = default;
     auto operator=(dynamic_bitset &&) -> dynamic_bitset &      = default;
 
+    struct reference {
+    public:
+        auto operator=(bool value) -> reference & {
+            m_bitset.set(m_index, value);
+            return *this;
+        }
+        auto operator=(const reference &rhs) -> reference & {
+            return *this = static_cast<bool>(rhs);
+        }
+        operator bool() const {
+            return m_bitset.test(m_index);
+        }
+
+    private:
+        friend struct dynamic_bitset;
+        reference(dynamic_bitset &b, std::size_t i) : m_bitset(b), m_index(i) {}
+        dynamic_bitset &m_bitset;
+        std::size_t m_index;
+    };
+
+    struct iterator {
+    public:
+        iterator() = default;
+        friend auto operator==(const iterator &lhs, const iterator &rhs) -> bool {
+            return lhs.m_index == rhs.m_index;
+        }
+        auto operator++() -> iterator & {
+            m_index = m_bitset->m_find(m_index + 1);
+            return *this;
+        }
+        auto operator++(int) -> iterator {
+            auto result = *this;
+            ++(*this);
+            return result;
+        }
+        auto operator*() const -> std::size_t {
+            return m_index;
+        }
+
+    private:
+        friend struct dynamic_bitset;
+        iterator(const dynamic_bitset &b, std::size_t i) : m_bitset(&b), m_index(i) {}
+        const dynamic_bitset *m_bitset = nullptr;
+        std::size_t m_index            = 0;
+    };
+
     template <std::ranges::sized_range _Range>
         requires std::unsigned_integral<std::ranges::range_value_t<_Range>>
     auto set_indices(const _Range &indices) -> void {
@@ -37,6 +94,7 @@ public:
     auto resize(std::size_t length) -> void {
         m_data.resize(s_required(length));
         m_length = length;
+        m_trim();
     }
 
     auto size() const -> std::size_t {
@@ -59,15 +117,68 @@ public:
         }
     }
 
+    // this = rhs << shift, resized to n
+    auto set_at(std::size_t n, std::size_t shift, const dynamic_bitset &rhs) -> void {
+        assume(n >= rhs.m_length + shift);
+        m_length = n;
+        m_data.assign(s_required(n), 0);
+        const auto [div, mod] = s_split(shift);
+        for (std::size_t i = 0; i < rhs.m_data.size(); ++i) {
+            m_data[i + div] |= rhs.m_data[i] << mod;
+            if (mod != 0 && i + div + 1 < m_data.size())
+                m_data[i + div + 1] |= rhs.m_data[i] >> (64 - mod);
+        }
+    }
+
+    auto expand(std::size_t n) const -> dynamic_bitset {
+        assume(n >= m_length);
+        auto result = *this;
+        result.resize(n);
+        return result;
+    }
+
+    auto subset(std::size_t n) const -> dynamic_bitset {
+        assume(n <= m_length);
+        auto result = *this;
+        result.resize(n);
+        return result;
+    }
+
     auto reset() -> void {
         for (auto &d : m_data)
             d = 0;
     }
 
+    auto set_all() -> void {
+        for (auto &d : m_data)
+            d = kMask;
+        m_trim();
+    }
+
+    auto any() const -> bool {
+        return std::ranges::any_of(m_data, [](word_t d) { return d != 0; });
+    }
+
+    auto none() const -> bool {
+        return !any();
+    }
+
+    auto count() const -> std::size_t {
+        auto result = std::size_t{};
+        for (const auto d : m_data)
+            result += std::popcount(d);
+        return result;
+    }
+
     auto operator[](std::size_t i) const -> bool {
         return test(i);
     }
 
+    auto operator[](std::size_t i) -> reference {
+        assume(i < m_length, "Subscript out of range");
+        return reference{*this, i};
+    }
+
     auto operator|=(const dynamic_bitset &rhs) -> dynamic_bitset & {
         assume(m_length == rhs.m_length);
         for (std::size_t i = 0; i < m_data.size(); ++i)
@@ -96,6 +207,27 @@ public:
         return result;
     }
 
+    auto hash() const -> std::uint64_t {
+        auto result = static_cast<std::uint64_t>(m_length);
+        for (const auto d : m_data)
+            result = std::rotl(result, 5) ^ d;
+        return result;
+    }
+
+    auto begin() const -> iterator {
+        return iterator{*this, m_find(0)};
+    }
+
+    auto end() const -> iterator {
+        return iterator{*this, m_length};
+    }
+
+    friend auto operator&(const dynamic_bitset &lhs, const dynamic_bitset &rhs) -> dynamic_bitset {
+        auto result = lhs;
+        result &= rhs;
+        return result;
+    }
+
     // using default operator== for comparison
     friend auto operator==(const dynamic_bitset &lhs, const dynamic_bitset &rhs) -> bool = default;
 
@@ -110,34 +242,57 @@ private:
     static auto s_split(std::size_t n) -> Pair {
         return Pair{n / 64, n % 64};
     }
-    std::size_t m_length;
+
+    // keep the bits beyond the length cleared, so that words compare and count as is
+    auto m_trim() -> void {
+        if (const auto mod = m_length % 64; mod != 0)
+            m_data.back() &= (1ULL << mod) - 1;
+    }
+
+    // first set bit at or after i, or the length if none
+    auto m_find(std::size_t i) const -> std::size_t {
+        if (i >= m_length)
+            return m_length;
+        auto [div, mod] = s_split(i);
+        auto word       = m_data[div] & (kMask << mod);
+        while (word == 0) {
+            if (++div == m_data.size())
+                return m_length;
+            word = m_data[div];
+        }
+        return div * 64 + std::countr_zero(word);
+    }
+
+    std::size_t m_length = 0;
     std::vector<word_t> m_data;
 };
 
-// don't use this anywhere else
-inline constexpr auto __bitsetN = 64;
-
-// why: i found that 64 bits is enough for my use case
-struct bitset : private std::bitset<__bitsetN> {
+// a bitset of at most _Nm bits, stored inline
+template <std::size_t _Nm>
+struct basic_bitset : private std::bitset<_Nm> {
 private:
-    using Base = std::bitset<__bitsetN>;
+    using Base = std::bitset<_Nm>;
+
+    static_assert(_Nm % 64 == 0, "Width must be a whole number of words");
 
     static auto m_check(std::size_t length) -> void {
-        assume(length <= __bitsetN, "Length must be less than or equal to 64");
+        assume(length <= _Nm, "Length must be less than or equal to {}", _Nm);
     }
 
     // private constructor for internal use
-    explicit bitset(const Base &b, std::size_t n) : Base(b), m_length(n) {}
+    explicit basic_bitset(const Base &b, std::size_t n) : Base(b), m_length(n) {}
 
     friend struct iterator;
 
+public:
     struct iterator {
     public:
+        iterator() = default;
         friend auto operator==(const iterator &lhs, const iterator &rhs) -> bool {
             return lhs.m_index == rhs.m_index;
         }
         auto operator++() -> iterator & {
-            m_index = m_bitset._Find_next(m_index);
+            m_index = m_bitset->_Find_next(m_index);
             return *this;
         }
         auto operator++(int) -> iterator {
@@ -150,44 +305,45 @@ private:
         }
 
     private:
-        friend struct bitset;
-        iterator(const bitset &b, std::size_t i) : m_bitset(b), m_index(i) {}
-        const bitset &m_bitset;
-        std::size_t m_index;
+        friend struct basic_bitset;
+        iterator(const basic_bitset &b, std::size_t i) : m_bitset(&b), m_index(i) {}
+        const basic_bitset *m_bitset = nullptr;
+        std::size_t m_index          = 0;
     };
 
+private:
     auto as_bitset() const -> const Base & {
         return static_cast<const Base &>(*this);
     }
 
 public:
-    using Base::reference;
+    using typename Base::reference;
 
-    explicit bitset() = default;
-    explicit bitset(std::size_t n) noexcept : Base(0), m_length(n) {
+    explicit basic_bitset() = default;
+    explicit basic_bitset(std::size_t n) noexcept : Base(0), m_length(n) {
         m_check(n);
     }
 
-    bitset(const bitset &)                     = default;
-    auto operator=(const bitset &) -> bitset & = default;
+    basic_bitset(const basic_bitset &)                     = default;
+    auto operator=(const basic_bitset &) -> basic_bitset & = default;
 
-    auto set_at(std::size_t n, std::size_t shift, const bitset &rhs) -> void {
+    auto set_at(std::size_t n, std::size_t shift, const basic_bitset &rhs) -> void {
         m_length = n;
         assume(n >= rhs.m_length + shift);
         static_cast<Base &>(*this) = (rhs << shift);
     }
 
-    auto expand(std::size_t n) const -> bitset {
+    auto expand(std::size_t n) const -> basic_bitset {
         m_check(n);
         assume(n >= m_length);
-        auto result = bitset{*this, n};
+        auto result = basic_bitset{*this, n};
         return result;
     }
 
-    auto subset(std::size_t n) const -> bitset {
+    auto subset(std::size_t n) const -> basic_bitset {
         assume(n <= m_length);
-        auto result = bitset{*this, n};
-        result &= Base((1ULL << n) - 1);
+        auto result = basic_bitset{*this, n};
+        result &= ~Base{} >> (_Nm - n);
         return result;
     }
 
@@ -204,8 +360,16 @@ public:
     }
 
     using Base::any;
+    using Base::count;
     using Base::none;
 
+    // the single word of a 64-bit set
+    auto to_word() const -> std::uint64_t
+        requires(_Nm == 64)
+    {
+        return Base::to_ullong();
+    }
+
     auto operator[](std::size_t i) const -> bool {
         assume(i < m_length, "Subscript out of range");
         return Base::operator[](i);
@@ -219,15 +383,17 @@ public:
     auto to_string() const -> std::string {
         auto result = std::string(m_length, '0');
         for (std::size_t i = 0; i < m_length; ++i)
-            if (test(i))
+            if (this->test(i))
                 result[i] = '1';
         return result;
     }
 
     // using default operator== for comparison
     auto hash() const -> std::uint64_t {
-        static_assert(sizeof(Base) == sizeof(std::uint64_t));
-        return Base::to_ullong();
+        if constexpr (_Nm == 64)
+            return Base::to_ullong();
+        else
+            return std::hash<Base>{}(as_bitset());
     }
 
     auto begin() const -> iterator {
@@ -235,15 +401,21 @@ public:
     }
 
     auto end() const -> iterator {
-        return iterator{*this, __bitsetN};
+        return iterator{*this, _Nm};
+    }
+
+    auto operator|=(const basic_bitset &rhs) -> basic_bitset & {
+        assume(m_length == rhs.m_length);
+        Base::operator|=(rhs.as_bitset());
+        return *this;
     }
 
-    friend auto operator&(const bitset &lhs, const bitset &rhs) -> bitset {
+    friend auto operator&(const basic_bitset &lhs, const basic_bitset &rhs) -> basic_bitset {
         assume(lhs.m_length == rhs.m_length);
-        return bitset{lhs.as_bitset() & rhs.as_bitset(), lhs.m_length};
+        return basic_bitset{lhs.as_bitset() & rhs.as_bitset(), lhs.m_length};
     }
 
-    friend auto operator==(const bitset &lhs, const bitset &rhs) -> bool {
+    friend auto operator==(const basic_bitset &lhs, const basic_bitset &rhs) -> bool {
         assume(lhs.m_length == rhs.m_length);
         return lhs.as_bitset() == rhs.as_bitset();
     }
@@ -252,13 +424,52 @@ private:
     std::size_t m_length;
 };
 
+// gather the bits of x selected by mask into the low bits (x86 PEXT)
+inline auto pext(std::uint64_t x, std::uint64_t mask) -> std::uint64_t {
+#ifdef __BMI2__
+    return _pext_u64(x, mask);
+#else
+    auto result = std::uint64_t{};
+    for (auto bit = std::uint64_t{1}; mask != 0; mask &= mask - 1, bit <<= 1)
+        if (x & mask & -mask)
+            result |= bit;
+    return result;
+#endif
+}
+
+// why: i found that 64 bits is enough for the atomic propositions,
+// and a single word is the fast path for formula and state sets
+using bitset = basic_bitset<64>;
+
+// Invoke fn with std::type_identity<B>{}, where B is the narrowest bitset
+// that holds n bits: one of 64/128/256/512 inline bits, or dynamic_bitset.
+template <typename _Fn>
+inline auto dispatch_bitset(std::size_t n, _Fn &&fn) -> decltype(auto) {
+    if (n <= 64)
+        return fn(std::type_identity<basic_bitset<64>>{});
+    if (n <= 128)
+        return fn(std::type_identity<basic_bitset<128>>{});
+    if (n <= 256)
+        return fn(std::type_identity<basic_bitset<256>>{});
+    if (n <= 512)
+        return fn(std::type_identity<basic_bitset<512>>{});
+    return fn(std::type_identity<dynamic_bitset>{});
+}
+
 } // namespace dark
 
 namespace std {
 
+template <std::size_t _Nm>
+struct hash<dark::basic_bitset<_Nm>> {
+    auto operator()(const dark::basic_bitset<_Nm> &bitset) const -> std::size_t {
+        return std::hash<std::uint64_t>{}(bitset.hash());
+    }
+};
+
 template <>
-struct hash<dark::bitset> {
-    auto operator()(const dark::bitset &bitset) const -> std::size_t {
+struct hash<dark::dynamic_bitset> {
+    auto operator()(const dark::dynamic_bitset &bitset) const -> std::size_t {
         return std::hash<std::uint64_t>{}(bitset.hash());
     }
 };
@@ -0,0 +1,59 @@
+#pragma once
+#include "irange.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace dark {
+
+// A fixed set of worker threads. run() hands out the tasks to the workers and to the
+// calling thread, so a run() nested in a task, or on a pool without workers, still
+// completes on the calling thread alone.
+struct ThreadPool {
+public:
+    // num_threads counts the calling thread, so the pool starts num_threads - 1 workers
+    explicit ThreadPool(std::size_t num_threads);
+
+    // shared by the whole process, with a thread per core unless configured
+    static auto global() -> ThreadPool &;
+    // replace the global pool, before any task runs on it
+    static auto configure(std::size_t num_threads) -> void;
+
+    // the threads which may run a task at once, including the calling thread
+    auto size() const -> std::size_t {
+        return workers.size() + 1;
+    }
+
+    // call fn(i) for each i in [0, num_tasks), and return once all are done.
+    // the first exception thrown by a task is rethrown here.
+    auto run(std::size_t num_tasks, std::function<void(std::size_t)> fn) -> void;
+
+private:
+    struct Job;
+
+    auto work(Job &) -> void;
+    auto loop(std::stop_token) -> void;
+
+    std::mutex mutex;
+    std::condition_variable_any wakeup;    // a job is queued
+    std::condition_variable finished;      // a job is done
+    std::deque<std::shared_ptr<Job>> jobs; // with some task not handed out yet
+    std::vector<std::jthread> workers;     // joined first, see ThreadPool::loop
+};
+
+// chunks per thread of a parallel loop, more than one so that uneven chunks balance out
+inline constexpr auto kChunksPerThread = std::size_t{4};
+
+// the c-th of num_chunks contiguous ranges, of about the same size, covering [0, size)
+inline auto chunk_of(std::size_t c, std::size_t num_chunks, std::size_t size)
+    -> integer_range<std::size_t> {
+    return irange(c * size / num_chunks, (c + 1) * size / num_chunks);
+}
+
+} // namespace dark
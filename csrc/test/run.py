@@ -1,25 +1,82 @@
 import os
+import shutil
+import tempfile
+
+# scratch directory of --external
+EXTERNAL = tempfile.mkdtemp(prefix="LTL-external-")
+
+# flags of the other engines, each checked against the .ans of every case
+ENGINES = [
+    "--distributed 3",
+    "--swarm 4",
+    "--parallel --threads 4",
+    "--bit-parallel",
+    f"--external {EXTERNAL} --memory 1",
+    f"--external {EXTERNAL} --memory 0.00005", # 3 states, so the sets spill to disk
+]
+
+# state numberings, each checked against the .ans of every case, single-state queries included
+ORDERS = ["rcm", "bfs"]
+
+def run_pass(
+    name: str, flags: str, expected: str, what: str, serve: bool = False, notes: bool = False
+) -> bool:
+    test_out = name + '.out'
+    # with serve, the queries of xxx.serve.txt are piped in instead of the LTL file
+    queries = f"--serve < {name}.serve.txt" if serve else f"--ltl {name}.ltl.txt"
+    # with notes, stderr is checked instead of the answers
+    redirect = f"2> {test_out} > /dev/null" if notes else f"> {test_out}"
+    if os.system(f"LTL --ts {name}.ts.txt {flags} {queries} {redirect}") != 0:
+        os.system(f"rm {test_out}")
+        print(f"[[Error]]: LTL crashed on {name.split('/')[-1]} at {expected} ({flags})")
+        return False
+
+    if os.system(f"diff -BZ {expected} {test_out} > /dev/null") != 0:
+        os.system(f"rm {test_out}")
+        print(f"[[Failed]]: LTL gave wrong {what} on {name}.ts.txt")
+        return False
+    return True
 
 def run_test(name: str) -> int | None:
     test_ts = name + '.ts.txt'
     test_ltl = name + '.ltl.txt'
     test_ans = name + '.ans'
     test_out = name + '.out'
+    test_fair = name + '.fair.txt' # optional fairness assumptions
+    test_cex = name + '.cex' # optional expected output with --counterexample
+    test_serve = name + '.serve' # optional expected replies to xxx.serve.txt with --serve
+    test_bit = name + '.bit' # optional expected notes with --bit-parallel
 
     for f in [test_ts, test_ltl, test_ans]:
         if not os.path.exists(f):
             print(f"[[Warning]]: {f} not found, skipping test")
             return None
 
-    if os.system(f"LTL --ts {test_ts} -S --ltl {test_ltl} > {test_out}") != 0:
-        os.system(f"rm {test_out}")
-        print(f"[[Error]]: LTL crashed on {name.split('/')[-1]} at {test_ans}")
+    fairness = f" --fairness {test_fair}" if os.path.exists(test_fair) else ""
+    if not run_pass(name, f"-S{fairness}", test_ans, "output"):
         return 0
 
-    if os.system(f"diff -BZ {test_ans} {test_out} > /dev/null") != 0:
-        os.system(f"rm {test_out}")
-        print(f"[[Failed]]: LTL gave wrong output on {test_ts}")
-        return 0
+    if os.path.exists(test_cex):
+        if not run_pass(name, "-S --counterexample", test_cex, "counterexamples"):
+            return 0
+
+    if os.path.exists(test_serve):
+        if not run_pass(name, "-S", test_serve, "replies", serve=True):
+            return 0
+
+    if os.path.exists(test_bit):
+        if not run_pass(name, "-S --bit-parallel", test_bit, "notes", notes=True):
+            return 0
+
+    for order in ORDERS:
+        if not run_pass(name, f"-S{fairness} --reorder {order}", test_ans, f"output with {order}"):
+            return 0
+
+    # the other engines must give the same answers (fairness is for nested DFS only)
+    if not fairness:
+        for flags in ENGINES:
+            if not run_pass(name, f"-S {flags}", test_ans, f"output with {flags}"):
+                return 0
 
     os.system(f"rm {test_out}") # clean up
     return 1
@@ -35,6 +92,7 @@ def main():
             if file.endswith('.ans'):
                 results.append(run_test(root + '/' + file[:-4]))
 
+    shutil.rmtree(EXTERNAL, ignore_errors=True)
     if len(results) == 0:
         print("No tests found")
         return
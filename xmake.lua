@@ -14,6 +14,12 @@ local other_cxflags = {
 
 set_languages("c++23")
 
+option("stats")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Collect per-query statistics for LTL --stats")
+option_end()
+
 target("antlr-g4")
     set_kind("static")
     add_includedirs("csrc/antlr", {public = true})
@@ -26,16 +32,39 @@ target("error-handler")
     add_cxflags(other_cxflags)
     add_includedirs("csrc/include")
     add_files("csrc/cpp/utils/*.cpp")
+    if is_plat("linux") then
+        add_syslinks("pthread", {public = true}) -- thread pool
+    end
 
-target("LTL")
-    set_kind("binary")
+target("ltl-core")
+    set_kind("static")
     add_deps("antlr-g4", "error-handler")
     set_warnings(warnings)
     add_cxflags(other_cxflags)
-    add_includedirs("csrc/include")
-    add_files("csrc/cpp/*.cpp")
-    add_packages("antlr4-runtime", "argparse")
+    add_includedirs("csrc/include", {public = true})
+    add_files("csrc/cpp/*.cpp|main.cpp")
+    add_packages("antlr4-runtime")
     if is_mode("debug") then
-        add_defines("_DARK_DEBUG")
+        add_defines("_DARK_DEBUG", {public = true})
+    end
+    if has_config("stats") then
+        add_defines("_DARK_STATS", {public = true})
     end
+
+target("LTL")
+    set_kind("binary")
+    add_deps("ltl-core")
+    set_warnings(warnings)
+    add_cxflags(other_cxflags)
+    add_files("csrc/cpp/main.cpp")
+    add_packages("antlr4-runtime", "argparse")
+    set_rundir("$(projectdir)")
+
+target("LTL-bench")
+    set_kind("binary")
+    add_deps("ltl-core")
+    set_warnings(warnings)
+    add_cxflags(other_cxflags)
+    add_files("csrc/bench/*.cpp")
+    add_packages("antlr4-runtime", "argparse")
     set_rundir("$(projectdir)")